@@ -452,3 +452,7 @@ ifeq ($(strip $(BOARD_BASEPARAMETER_SUPPORT)), true)
     endif
         BOARD_WITH_SPECIAL_PARTITIONS := baseparameter:1M
 endif
+
+# [bug fix] mspark, 26.10.17, platform policy of the /system daemons (armon)
+SYSTEM_EXT_PUBLIC_SEPOLICY_DIRS += device/rockchip/common/sepolicy/system_ext/public
+SYSTEM_EXT_PRIVATE_SEPOLICY_DIRS += device/rockchip/common/sepolicy/system_ext/private
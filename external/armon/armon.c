@@ -1,112 +1,382 @@
+#define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <signal.h>
+#include <dirent.h>
+#include <sched.h>
 
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <linux/input.h>
+#include <linux/netlink.h>
 
 #include "cutils/log.h"
 #include "cutils/properties.h"
+#include "cutils/sockets.h"
+
+#include "armon_ctl.h"
+#include "armon_tlm.h"
+#include "armon_core.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
-#define VOLUME_MAX			(15)
-#define VOLUME_DEFAULT		(12)	// 80%
-#define VOLUME_RATIO		(4)	// 2dB
-#define VOLUME_LEVEL		(((VOLUME_MAX-1)*VOLUME_RATIO) - 1)
+#define PATH_PANEL			"/sys/bus/i2c/devices/3-004c"
+#define PATH_AUDIO			"/sys/bus/i2c/devices/1-0038"
+#define PATH_INPUT			"/dev/input"
+#define PATH_STATE			"/metadata/armon/state"
+#define PATH_LIGHT			"/dev/lightsensor"
 
-#define BRIGHTNESS_MAX		(4)
-#define BRIGHTNESS_DEFAULT	(4)
+#define UEVENT_PANEL		"3-004c"	// sy060 panel i2c client
+#define UEVENT_ARG_IO		"arg_io"	// panel / bridge reset lines
+#define UEVENT_MSG_LEN		2048
+#define UEVENT_RCVBUF		(64 * 1024)
+#define LIGHT_DEV_NAME		"lightsensor-level"
 
-#define LONGKEY_CNT			10	// 1sec
-#define REPEAT_CNT			3	// 3sec
+// rockchip sensor framework (include/linux/sensor-dev.h)
+#define LIGHTSENSOR_IOCTL_MAGIC		'l'
+#define LIGHTSENSOR_IOCTL_ENABLE	_IOW(LIGHTSENSOR_IOCTL_MAGIC, 2, int *)
 
-#define PATH_PANEL			"/sys/bus/i2c/devices/3-004c"
-#define PATH_AUDIO			"/sys/bus/i2c/devices/1-0038"
+#define SUSPEND_MIN_NS		10000000LL	// boottime gap that counts as a suspend
+#define STACK_PREFAULT		(64 * 1024)	// stack locked in by the low-latency profile
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK			0x40000000
+#endif
+#ifndef SCHED_FLAG_KEEP_PARAMS
+#define SCHED_FLAG_KEEP_PARAMS		0x10
+#define SCHED_FLAG_UTIL_CLAMP_MIN	0x20
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE			0x0010	// linux 5.1
+#endif
+
+#define STATE_MAGIC			0x54534d41	// "AMST"
+#define STATE_VERSION		1
+
+#define EPOLL_MAX_EVENTS	8
+#define KEY_DEV_MAX			8
+#define KEY_READ_MAX		64	// input events per read
+#define KEY_FRAME_MAX		8	// key events buffered per SYN_REPORT frame
+#define CTL_CLIENT_MAX		8
+
+// state file, restored by the early stage before /data is mounted
+typedef struct
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	size;
+	int16_t		brightness;		// manual brightness
+	int16_t		volume;
+	int16_t		display;
+	int16_t		rotate;
+	int16_t		auto_mode;
+	int16_t		reserved;
+	uint32_t	sum;
+}STATE_FILE;
+
+// epoll source : every fd in the loop carries its own handler
+typedef struct _EPOLL_SOURCE
+{
+	int			fd;
+	int			id;
+	int			wakeup;		// EPOLLWAKEUP : suspend is held off until the event is handled
+	void		(*handler)(struct _EPOLL_SOURCE *src, uint32_t events);
+}EPOLL_SOURCE;
 
 typedef enum
-{	
-	KEY_VOLUME_DOWN = 114,		// Volume down
-	KEY_VOLUME_UP,				// Volume up
-	KEY_BRIGHTNESS_DOWN	= 224,	// Brightness down
-	KEY_BRIGHTNESS_UP,			// Brightness up
-}_KEY_DATA;
- 
-typedef enum
 {
-	tId_Key,
-	tId_Max
-}_TIMER_ID;
+	dev_Key,		// reports at least one of our keys
+	dev_Light,		// ambient light sensor
+}_DEV_TYPE;
+
+// input device in the loop
+typedef struct
+{
+	EPOLL_SOURCE	src;
+	char			name[16];	// node name under /dev/input
+	int				type;		// dev_Key / dev_Light
+	int				dropped;	// SYN_DROPPED seen, wait for SYN_REPORT
+	int				frame_cnt;
+	struct {
+		int			code;
+		int			value;
+	} frame[KEY_FRAME_MAX];		// key events of the open frame
+}KEY_DEV;
 
+// control socket client
+typedef struct
+{
+	EPOLL_SOURCE	src;
+	unsigned int	subscribe;	// ARMON_FIELD bits to push on change
+}CTL_CLIENT;
 
-#define GET_TIMER_ID(id)		(SIGRTMAX-tId_Max+id)
-#define SET_TIMER_ID(id)		(id - SIGRTMAX + tId_Max)
+// sysfs control attribute, opened once and reused for every step
+typedef struct
+{
+	const char	*basedir;
+	const char	*name;
+	int			field;		// ARMON_FIELD
+	int			fd;
+}SYS_NODE;
 
-#define TIMEOUT_TS		10000//15000
-#define TIMEOUT_KEY		100
+#define IO_COUNT()		(g_io.calls++, g_io.press_calls++)
 
+// system suspend accounting
 typedef struct
 {
-	int			sleep;			// sleep status
-	int			mode;			// mode
-	int			cnt;
-	int			delay;
-	int			long_tick;		// long key check
-	int			repeat_tick;	// repeat key check
-	int			key_code	;	// key code
-	int			volume;			// volume
-	int			brightness;		// brightness
-}SYS_STATUS;
-SYS_STATUS g_status;
+	int64_t			offset_ns;		// CLOCK_BOOTTIME - CLOCK_MONOTONIC at the last wakeup
+	unsigned int	suspends;		// suspends seen by the loop
+	unsigned int	wakeups;		// wakeups holding suspend off
+	uint64_t		blocked_ns;		// time suspend was held off by our events
+	uint64_t		hold_ns;		// start of the current hold (0 : none)
+}PM_STAT;
+PM_STAT g_pm;
+
+// scheduling delay of the loop per wakeup source (ARMON_TLM_SCHED), mirrored in the telemetry ring
+struct armon_tlm_sched g_sched[ARMON_TLM_SCHED_MAX];
+
+// struct sched_attr up to the uclamp fields (linux 5.3)
+struct sched_attr_uclamp
+{
+	uint32_t	size;
+	uint32_t	sched_policy;
+	uint64_t	sched_flags;
+	int32_t		sched_nice;
+	uint32_t	sched_priority;
+	uint64_t	sched_runtime;
+	uint64_t	sched_deadline;
+	uint64_t	sched_period;
+	uint32_t	sched_util_min;
+	uint32_t	sched_util_max;
+};
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static timer_t	g_tId[tId_Max];
+static int			g_epfd = -1;
+static EPOLL_SOURCE	g_timer[tId_Max];
+static int			g_timer_run[tId_Max];
+static int			g_timer_repeat[tId_Max];
+static uint64_t		g_timer_due[tId_Max];		// next expiry, CLOCK_MONOTONIC ns
+static uint64_t		g_timer_period[tId_Max];	// ns, 0 : one-shot
+static KEY_DEV		g_keydev[KEY_DEV_MAX];
+static EPOLL_SOURCE	g_keydir;
+static EPOLL_SOURCE	g_uevent;
+static unsigned int	g_reapply_cnt = 0;
+static EPOLL_SOURCE	g_signal;
+static EPOLL_SOURCE	g_ctl;
+static CTL_CLIENT	g_client[CTL_CLIENT_MAX];
+static const char	*g_root = "";	// sysfs prefix, a fake tree for host tests
+static const char	*g_sock_path = NULL;
+static const char	*g_key_filter = NULL;	// only take key devices with this name
+static const char	*g_state_path = PATH_STATE;
+static int			g_state_fd = -1;
+static int			g_light_fd = -1;	// /dev/lightsensor, sensor enable
+static struct armon_tlm	*g_tlm = NULL;	// telemetry ring, NULL when disabled
+static int			g_tlm_fd = -1;
+static uint64_t		g_tlm_event_ns;		// origin of the writes being dispatched
+static uint64_t		g_tlm_dispatch_ns;
+static int			g_quit = 0;
+static int			g_sched_cpu = -1;	// low-latency profile : pinned cpu
+static int			g_sched_prio = 0;	// SCHED_FIFO priority, 0 : CFS
+static int			g_sched_uclamp = 0;	// CFS uclamp.min (0..1024)
+static int			g_sched_lock = 0;	// mlockall after init
+static int			g_props_ready = 0;	// no /data to wait for (host, replay)
+static SYS_NODE		g_node[node_Max] = {	// group_xxx : every panel (both eyes) in one write
+	[node_Brightness]	= { PATH_PANEL, "group_brightness", ARMON_FIELD_BRIGHTNESS, -1 },
+	[node_Volume]		= { PATH_AUDIO, "volume", ARMON_FIELD_VOLUME, -1 },
+	[node_Display]		= { PATH_PANEL, "group_display", ARMON_FIELD_DISPLAY, -1 },
+	[node_Rotate]		= { PATH_PANEL, "group_rotate", ARMON_FIELD_ROTATE, -1 },
+};
 
-void timer_handler(int id, siginfo_t * info, void *context);
+int timer_start(int id, int delay, int repeat);
+void timer_stop(int id);
+int is_timer_running(int id);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int dev_wr_status(char *filename, char *basedir, int status)
+static inline uint64_t now_ns(void)
 {
-	FILE  *fp;
-	char tmp[100];
+	struct timespec ts;
 
-	memset(tmp, 0x00, sizeof(tmp));
-	sprintf(tmp, "%s/%s", basedir, filename);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-	fp = fopen(tmp, "w");
-	if (fp == NULL) {
-		printf("failed to open %s\n", tmp);
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// start of a dispatch : event_ns is the evdev timestamp, 0 when the origin is armon itself
+void tlm_event(uint64_t event_ns)
+{
+	g_tlm_dispatch_ns = now_ns();
+	g_tlm_event_ns = event_ns ? event_ns : g_tlm_dispatch_ns;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// single producer, no lock : a reader detects a slot being rewritten by its odd seq
+void tlm_put(int kind, int field, int value, int bytes, int error)
+{
+	struct armon_tlm_rec *rec;
+	uint64_t head;
+	uint32_t seq;
+
+	if (g_tlm == NULL)
+		return;
+
+	head = g_tlm->head;
+	rec = &g_tlm->rec[head & (ARMON_TLM_SIZE - 1)];
+	seq = rec->seq;
+
+	__atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec->kind = kind;
+	rec->source = field;
+	rec->bytes = bytes;
+	rec->error = error;
+	rec->value = value;
+	rec->event_ns = g_tlm_event_ns;
+	rec->dispatch_ns = g_tlm_dispatch_ns;
+	rec->done_ns = now_ns();
+
+	__atomic_store_n(&rec->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&g_tlm->head, head + 1, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int tlm_init(void)
+{
+	g_tlm_fd = memfd_create("armon_tlm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (g_tlm_fd < 0) {
+		ALOGE("[armon] memfd_create error, %s\n", strerror(errno));
 		return -1;
 	}
-	fprintf(fp, "%d", status);
-	fclose(fp);
 
-	return 0;	
+	if (ftruncate(g_tlm_fd, sizeof(struct armon_tlm)) < 0)
+		goto err;
+
+	g_tlm = mmap(NULL, sizeof(struct armon_tlm), PROT_READ | PROT_WRITE, MAP_SHARED, g_tlm_fd, 0);
+	if (g_tlm == MAP_FAILED) {
+		g_tlm = NULL;
+		goto err;
+	}
+
+	// readers may rely on the size, pin it. Clients get this fd : only the mapping above may write,
+	// a client can not map it writable. No telemetry rather than a ring any client can corrupt
+	if (fcntl(g_tlm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		munmap(g_tlm, sizeof(struct armon_tlm));
+		g_tlm = NULL;
+		goto err;
+	}
+
+	// fault the whole ring in now, not on the key path
+	memset(g_tlm, 0, sizeof(struct armon_tlm));
+	g_tlm->magic = ARMON_TLM_MAGIC;
+	g_tlm->version = ARMON_TLM_VERSION;
+	g_tlm->size = ARMON_TLM_SIZE;
+	g_tlm->rec_size = sizeof(struct armon_tlm_rec);
+
+	return 0;
+
+err:
+	ALOGE("[armon] telemetry ring error, %s\n", strerror(errno));
+	close(g_tlm_fd);
+	g_tlm_fd = -1;
+	return -1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int dev_rd_status(char *filename, char *basedir)
+int dev_open(int id)
 {
-	FILE  *fp;
-	int ret;
-	char tmp[100];
+	SYS_NODE *node = &g_node[id];
+	char tmp[256];
 
-	memset(tmp, 0, sizeof(tmp));
-	sprintf(tmp, "%s/%s", basedir, filename);
+	if (node->fd >= 0)
+		return node->fd;
+
+	snprintf(tmp, sizeof(tmp), "%s%s/%s", g_root, node->basedir, node->name);
+
+	IO_COUNT();
+	node->fd = open(tmp, O_RDWR | O_CLOEXEC);
+	if (node->fd < 0)
+		ALOGE("[armon] failed to open %s, %s\n", tmp, strerror(errno));
 
-	fp = fopen(tmp, "r");
-	if (fp == NULL) {
-		printf("failed to open %s\n", tmp);
+	return node->fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void dev_close(int id)
+{
+	SYS_NODE *node = &g_node[id];
+
+	if (node->fd >= 0) {
+		IO_COUNT();
+		close(node->fd);
+		node->fd = -1;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int dev_wr_status(int id, int status)
+{
+	char tmp[16];
+	int len, retry, ret;
+
+	len = snprintf(tmp, sizeof(tmp), "%d", status);
+
+	// a stale fd (device unbound and rebound) is reopened once
+	for (retry = 0; retry < 2; retry++) {
+		if (dev_open(id) < 0) {
+			tlm_put(ARMON_TLM_SYSFS, g_node[id].field, status, 0, errno);
+			return -1;
+		}
+
+		IO_COUNT();
+		ret = pwrite(g_node[id].fd, tmp, len, 0);
+		if (ret == len) {
+			tlm_put(ARMON_TLM_SYSFS, g_node[id].field, status, ret, 0);
+			return 0;
+		}
+
+		ALOGE("[armon] failed to write %s, %s\n", g_node[id].name, strerror(errno));
+		if (errno != ENODEV && errno != EBADF && errno != ENXIO)
+			break;
+		dev_close(id);
+	}
+	tlm_put(ARMON_TLM_SYSFS, g_node[id].field, status, ret > 0 ? ret : 0, ret < 0 ? errno : EIO);
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int dev_rd_status(int id)
+{
+	char tmp[16];
+	int len;
+
+	if (dev_open(id) < 0)
+		return -1;
+
+	IO_COUNT();
+	len = pread(g_node[id].fd, tmp, sizeof(tmp) - 1, 0);
+	if (len <= 0) {
+		ALOGE("[armon] failed to read %s, %s\n", g_node[id].name, strerror(errno));
 		return -1;
 	}
-	fscanf(fp, "%d\n", &ret);
-	fclose(fp);
+	tmp[len] = '\0';
 
-	return ret;
+	return ar_atoi(tmp);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -118,104 +388,207 @@ int dev_remove_file(char *filename, char *basedir)
 	sprintf(tmp, "%s/%s", basedir, filename);
 	return remove(tmp);
 }
-///////////////////////////////////////////////////////////////////////////////////////
-int ar_atoi(char *s)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static uint32_t state_sum(const STATE_FILE *st)
 {
-        int k = 0;
+	const uint8_t *p = (const uint8_t *)st;
+	uint32_t sum = 2166136261u;		// FNV-1a
+	unsigned int i;
 
-        k = 0;
-        while (*s != '\0' && *s >= '0' && *s <= '9') {
-                k = 10 * k + (*s - '0');
-                s++;
-        }
-        return k;
+	for (i=0; i<offsetof(STATE_FILE, sum); i++)
+		sum = (sum ^ p[i]) * 16777619u;
+	return sum;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void set_volume(int level)
+// compact copy of the live values, readable long before /data and the persist properties
+int state_load(STATE_FILE *st)
 {
-	char buf[PROPERTY_VALUE_MAX+1];	
-	dev_wr_status("volume", PATH_AUDIO, level);	
-	sprintf(buf, "%d", level);
-	property_set("persist.prazen.volume", buf);
-	g_status.volume = level;
+	g_state_fd = open(g_state_path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+	if (g_state_fd < 0) {
+		ALOGE("[armon] could not open %s, %s\n", g_state_path, strerror(errno));
+		return -1;
+	}
+
+	IO_COUNT();
+	if (pread(g_state_fd, st, sizeof(*st), 0) != sizeof(*st) ||
+		st->magic != STATE_MAGIC || st->version != STATE_VERSION ||
+		st->size != sizeof(*st) || st->sum != state_sum(st))
+		return -1;
+
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int get_volume(void)
+void state_save(void)
 {
-	char buf[PROPERTY_VALUE_MAX+1];
-	property_get("persist.prazen.volume", buf, NULL);
-	return ar_atoi(buf);
+	STATE_FILE st;
+
+	if (g_state_fd < 0)
+		return;
+
+	memset(&st, 0, sizeof(st));
+	st.magic = STATE_MAGIC;
+	st.version = STATE_VERSION;
+	st.size = sizeof(st);
+	st.brightness = g_status.manual_brightness;
+	st.volume = g_status.volume;
+	st.display = g_status.display;
+	st.rotate = g_status.rotate;
+	st.auto_mode = g_status.auto_mode;
+	st.sum = state_sum(&st);
+
+	// one sector, rewritten in place : a torn write fails the checksum and falls back to the properties
+	IO_COUNT();
+	if (pwrite(g_state_fd, &st, sizeof(st), 0) != sizeof(st))
+		ALOGE("[armon] state write error, %s\n", strerror(errno));
+	IO_COUNT();
+	fdatasync(g_state_fd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void set_brightness(int value)
+static void persist_write(const char *key, int field, int value)
 {
 	char buf[PROPERTY_VALUE_MAX+1];	
-	ALOGD("[armon] set brightness = %d\n", value);
-	dev_wr_status("brightness", PATH_PANEL, value);	
-	sprintf(buf, "%d", value);
-	property_set("persist.prazen.brightness", buf);
-	g_status.brightness = value;
+	int len, ret;
+
+	len = sprintf(buf, "%d", value);
+	IO_COUNT();	// property service round trip
+	ret = property_set(key, buf);
+	tlm_put(ARMON_TLM_PROPERTY, field, value, ret < 0 ? 0 : len, ret < 0 ? -ret : 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int get_brightness(void)
+static void light_enable(int on)
 {
-	char buf[PROPERTY_VALUE_MAX+1];
-	property_get("persist.prazen.brightness", buf, NULL);
-	return ar_atoi(buf);
+	if (g_light_fd < 0)
+		g_light_fd = open(PATH_LIGHT, O_RDONLY | O_CLOEXEC);
+	if (g_light_fd < 0) {
+		ALOGE("[armon] could not open %s, %s\n", PATH_LIGHT, strerror(errno));
+		return;
+	}
+	if (ioctl(g_light_fd, LIGHTSENSOR_IOCTL_ENABLE, &on) < 0)
+		ALOGE("[armon] light sensor enable(%d) error, %s\n", on, strerror(errno));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void timer_init(void)
+int epoll_add(EPOLL_SOURCE *src)
 {
-	int i=0;
+	struct epoll_event ev;
 
-	for (i=0; i<tId_Max; i++)
-		g_tId[i] = 0;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | (src->wakeup ? EPOLLWAKEUP : 0);
+	ev.data.ptr = src;
+
+	if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, src->fd, &ev) < 0) {
+		ALOGE("[armon] epoll add fd %d failed, %s\n", src->fd, strerror(errno));
+		return -1;
+	}
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int timer_start(int id, int delay)
+void epoll_del(EPOLL_SOURCE *src)
 {
-	timer_t timerid;
-	struct sigaction sigact;
-	struct sigevent sigev;
-	struct itimerspec itval;
-	struct itimerspec oitval;
+	if (src->fd >= 0) {
+		epoll_ctl(g_epfd, EPOLL_CTL_DEL, src->fd, NULL);
+		close(src->fd);
+		src->fd = -1;
+	}
+}
 
-	sigemptyset(&sigact.sa_mask);
-	sigact.sa_flags = SA_SIGINFO;
-	sigact.sa_sigaction = timer_handler;
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// how late the loop ran after a wakeup source fired : runqueue wait + wakeup, what the low-latency profile is meant
+// to cut. Published in the telemetry ring so armon_stat shows it while armon runs
+static void sched_account(int src, uint64_t due)
+{
+	struct armon_tlm_sched *st = &g_sched[src];
+	uint64_t now = now_ns();
+	uint64_t late = (now > due) ? now - due : 0;
 
-	// Set up sigaction to catch signal
-	if (sigaction(GET_TIMER_ID(id), &sigact, NULL) == -1) {
-		perror("sigaction failed");
-		return -1;
+	st->count++;
+	st->total_ns += late;
+	if (late > st->max_ns)
+		st->max_ns = late;
+
+	if (g_tlm == NULL)
+		return;
+	__atomic_store_n(&g_tlm->sched[src].count, st->count, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_tlm->sched[src].total_ns, st->total_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_tlm->sched[src].max_ns, st->max_ns, __ATOMIC_RELAXED);
+}
+
+static void sched_timer(int id, uint64_t expired)
+{
+	uint64_t due = g_timer_due[id] + (expired - 1) * g_timer_period[id];
+
+	g_timer_due[id] = due + g_timer_period[id];
+	sched_account(ARMON_TLM_SCHED_TIMER, due);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void timer_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	uint64_t expired = 0;
+
+	if (read(src->fd, &expired, sizeof(expired)) != sizeof(expired))
+		return;
+
+	tlm_event(0);
+	sched_timer(src->id, expired);
+
+	if (!g_timer_repeat[src->id]) {
+		g_timer_run[src->id] = 0;
+		timer_handler(src->id);
+		return;
 	}
-			
-	// Create the POSIX timer to generate signo
-	sigev.sigev_notify = SIGEV_SIGNAL;
-	sigev.sigev_signo = GET_TIMER_ID(id);
-	sigev.sigev_value.sival_ptr = &timerid;
 
-	if (timer_create(CLOCK_REALTIME, &sigev, &timerid) == 0) {
-		itval.it_value.tv_sec = delay / 1000;
-		itval.it_value.tv_nsec = (long)(delay % 1000) * (1000000L);
-		itval.it_interval.tv_sec = itval.it_value.tv_sec;
-		itval.it_interval.tv_nsec = itval.it_value.tv_nsec;
+	// a late wakeup reports every missed period, keep the step count honest
+	while (expired-- > 0 && g_timer_run[src->id])
+		timer_handler(src->id);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int timer_init(void)
+{
+	int i=0;
 
-		if (timer_settime(timerid, 0, &itval, &oitval) != 0) {
-			perror("time_settime error!");
+	for (i=0; i<tId_Max; i++) {
+		g_timer_run[i] = 0;
+		g_timer[i].id = i;
+		g_timer[i].handler = timer_event;
+		g_timer[i].wakeup = (i == tId_Key);	// a repeat tick in flight completes before suspend
+		g_timer[i].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (g_timer[i].fd < 0) {
+			ALOGE("[armon] timerfd_create error, %s\n", strerror(errno));
+			return -1;
 		}
-	} else {
-		perror("timer_create error!");
+		if (epoll_add(&g_timer[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int timer_start(int id, int delay, int repeat)
+{
+	struct itimerspec itval;
+
+	itval.it_value.tv_sec = delay / 1000;
+	itval.it_value.tv_nsec = (long)(delay % 1000) * (1000000L);
+	itval.it_interval.tv_sec = repeat ? itval.it_value.tv_sec : 0;
+	itval.it_interval.tv_nsec = repeat ? itval.it_value.tv_nsec : 0;
+
+	if (timerfd_settime(g_timer[id].fd, 0, &itval, NULL) != 0) {
+		ALOGE("[armon] timerfd_settime error, %s\n", strerror(errno));
 		return -1;
 	}
 
-	g_tId[id] =  timerid;
+	g_timer_run[id] = 1;
+	g_timer_repeat[id] = repeat;
+	g_timer_period[id] = repeat ? (uint64_t)delay * 1000000ULL : 0;
+	g_timer_due[id] = now_ns() + (uint64_t)delay * 1000000ULL;
 
 	return 0;
 }
@@ -223,158 +596,1033 @@ int timer_start(int id, int delay)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void timer_stop(int id)
 {
-	if (g_tId[id]) {
-		timer_delete(g_tId[id]);
-		g_tId[id] = 0;
+	struct itimerspec itval;
+
+	if (g_timer_run[id]) {
+		memset(&itval, 0, sizeof(itval));
+		timerfd_settime(g_timer[id].fd, 0, &itval, NULL);
+		g_timer_run[id] = 0;
 	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int is_timer_running(int id)
 {
-	return (g_tId[id] ? 1 : 0);
+	return g_timer_run[id];
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void timer_handler(int id, siginfo_t *info, void *context)
+void key_dev_close(int id)
 {
-	siginfo_t *siginfo = info;
-	void *tmp = context;
-		
-	switch (SET_TIMER_ID(id)) 
-	{
-		case tId_Key:
-			if (g_status.long_tick < LONGKEY_CNT)
-			{
-				g_status.long_tick++;
-			}
-			else 
-			{
-				switch (g_status.key_code)
-				{
-					case KEY_VOLUME_UP:
-						if (g_status.volume < VOLUME_MAX) {
-							set_volume(get_volume() + 1);
-						}
-						break;
-						
-					case KEY_VOLUME_DOWN:
-						if (g_status.volume > 0) {
-							set_volume(get_volume() - 1);
-						}
-						break;
-						
-					case KEY_BRIGHTNESS_UP:
-						if (g_status.brightness < VOLUME_MAX) {
-							set_brightness(get_brightness() + 1);
-						}
-						break;
-						
-					case KEY_BRIGHTNESS_DOWN:
-						if (g_status.brightness > 0) {
-							set_brightness(get_brightness() - 1);
-						}
-						break;							
-				}	
-			}
-			break;
-        }
+	KEY_DEV *dev = &g_keydev[id];
+
+	if (dev->src.fd < 0)
+		return;
+
+	ALOGD("[armon] input device %s removed\n", dev->name);
+	epoll_del(&dev->src);
+	dev->name[0] = '\0';
+
+	// the key up of a held key will never arrive from a removed device
+	if (dev->type == dev_Key)
+		key_release();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void* keyevent_thread(void* arg)
+// after SYN_DROPPED the queued events are lost, take the key state from the driver instead
+void key_resync(KEY_DEV *dev)
 {
-	int res;
-	struct input_event event;
-	void *tmp = arg;
-	int fd = open("/dev/input/event9", O_RDWR);
+	unsigned char bits[KEY_MAX / 8 + 1];
+	int code;
 
-	if (fd < 0)
-	{
-		ALOGE("[armon] could not open input event9, %s\n", strerror(errno));
-		return NULL;
+	ALOGD("[armon] key device %s resync\n", dev->name);
+
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(dev->src.fd, EVIOCGKEY(sizeof(bits)), bits) < 0) {
+		key_release();
+		return;
 	}
 
-	while (1) 
-	{		
-		res = read(fd, &event, sizeof(event));
-		if (res < (int)sizeof(event)) {
-			ALOGE("[armon] key read fail = %d\n", event.code);
-			continue;
+	// a held power / back key is not ours to replay
+	for (code = KEY_VOLUME_DOWN; code <= KEY_BRIGHTNESS_UP; code++) {
+		if (key_handled(code) && (bits[code / 8] & (1 << (code % 8)))) {
+			if (!is_timer_running(tId_Key))
+				key_process(code, 1);
+			return;
 		}
+	}
 
-		if (event.type==1 && (KEY_VOLUME_DOWN <= event.code && event.code <= KEY_BRIGHTNESS_UP)) {
-			g_status.key_code = event.code;
-			
-			// key up			
-			if (event.value == 0) {
-				if (is_timer_running(tId_Key)) {
-					g_status.long_tick = 0;
-					timer_stop(tId_Key);
-				}
+	// nothing held any more: stop a repeat whose key up was dropped
+	key_release();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void light_frame(KEY_DEV *dev, struct input_event *event)
+{
+	struct input_absinfo abs;
 
-				ALOGD("[armon] key code = %d\n", event.code);
-				switch (event.code)
-				{
-					case KEY_VOLUME_UP:
-						if (g_status.volume < VOLUME_MAX) {
-							set_volume(get_volume() + 1);
-						}
-						break;
-						
-					case KEY_VOLUME_DOWN:
-						if (g_status.volume > 0) {
-							set_volume(get_volume() - 1);
-						}
-						break;
-
-					case KEY_BRIGHTNESS_UP:
-						if (g_status.brightness < VOLUME_MAX) {
-							set_brightness(get_brightness() + 1);
-						}
-						break;
-						
-					case KEY_BRIGHTNESS_DOWN:
-						if (g_status.brightness > 0) {
-							set_brightness(get_brightness() - 1);
-						}
-						break;						
+	if (event->type == EV_SYN) {
+		switch (event->code)
+		{
+			case SYN_REPORT:
+				if (dev->dropped) {
+					dev->dropped = 0;
+					if (ioctl(dev->src.fd, EVIOCGABS(ABS_MISC), &abs) >= 0)
+						auto_sample(abs.value);
+				} else if (dev->frame_cnt) {
+					auto_sample(dev->frame[0].value);
 				}
-			} else { // key down
-				if (!is_timer_running(tId_Key)) {
-					timer_start(tId_Key, TIMEOUT_KEY);
+				dev->frame_cnt = 0;
+				break;
+
+			case SYN_DROPPED:
+				dev->dropped = 1;
+				dev->frame_cnt = 0;
+				break;
+		}
+		return;
+	}
+
+	// only the last bucket of a frame matters
+	if (event->type == EV_ABS && event->code == ABS_MISC && !dev->dropped) {
+		dev->frame[0].code = event->code;
+		dev->frame[0].value = event->value;
+		dev->frame_cnt = 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void key_frame(KEY_DEV *dev, struct input_event *event)
+{
+	int i;
+
+	if (dev->type == dev_Light) {
+		light_frame(dev, event);
+		return;
+	}
+
+	if (event->type == EV_SYN) {
+		switch (event->code)
+		{
+			case SYN_REPORT:
+				tlm_event((uint64_t)event->time.tv_sec * 1000000000ULL + event->time.tv_usec * 1000ULL);
+				sched_account(ARMON_TLM_SCHED_INPUT, g_tlm_event_ns);
+				if (dev->dropped) {
+					dev->dropped = 0;
+					key_resync(dev);
+				} else {
+					for (i=0; i<dev->frame_cnt; i++)
+						key_process(dev->frame[i].code, dev->frame[i].value);
 				}
+				dev->frame_cnt = 0;
+				break;
+
+			case SYN_DROPPED:
+				dev->dropped = 1;
+				dev->frame_cnt = 0;
+				break;
+		}
+		return;
+	}
+
+	if (event->type != EV_KEY || dev->dropped)
+		return;
+
+	// a frame never carries more keys than we track, but never overrun
+	if (dev->frame_cnt == KEY_FRAME_MAX) {
+		for (i=0; i<dev->frame_cnt; i++)
+			key_process(dev->frame[i].code, dev->frame[i].value);
+		dev->frame_cnt = 0;
+	}
+	dev->frame[dev->frame_cnt].code = event->code;
+	dev->frame[dev->frame_cnt].value = event->value;
+	dev->frame_cnt++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void key_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	KEY_DEV *dev = &g_keydev[src->id];
+	struct input_event event[KEY_READ_MAX];
+	int res, i, n;
+
+	if (events & (EPOLLHUP | EPOLLERR)) {
+		key_dev_close(src->id);
+		return;
+	}
+
+	// drain the queue, a burst costs one read per KEY_READ_MAX events
+	do {
+		res = read(src->fd, event, sizeof(event));
+		if (res < 0) {
+			if (errno == ENODEV)
+				key_dev_close(src->id);
+			else if (errno != EAGAIN && errno != EINTR)
+				ALOGE("[armon] key read fail, %s\n", strerror(errno));
+			return;
+		}
+
+		n = res / sizeof(struct input_event);
+		for (i=0; i<n && src->fd >= 0; i++)
+			key_frame(dev, &event[i]);
+	} while (n == KEY_READ_MAX && src->fd >= 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int key_dev_match(int fd, const char *devname)
+{
+	static const int keys[] = {
+		KEY_VOLUMEDOWN, KEY_VOLUMEUP, KEY_BRIGHTNESSDOWN, KEY_BRIGHTNESSUP
+	};
+	unsigned char bits[KEY_MAX / 8 + 1];
+	unsigned int i;
+
+	// the ALS reports its lux bucket as ABS_MISC on a device of its own
+	if (!strcmp(devname, LIGHT_DEV_NAME)) {
+		memset(bits, 0, sizeof(bits));
+		if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) >= 0 &&
+			(bits[ABS_MISC / 8] & (1 << (ABS_MISC % 8))))
+			return dev_Light;
+		return -1;
+	}
+
+	if (g_key_filter && strcmp(devname, g_key_filter))
+		return -1;
+
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) < 0)
+		return -1;
+
+	for (i=0; i<sizeof(keys)/sizeof(keys[0]); i++) {
+		if (bits[keys[i] / 8] & (1 << (keys[i] % 8)))
+			return dev_Key;
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// open /dev/input/<name> when it reports one of our keys, any number of devices share the loop
+int key_dev_open(const char *name)
+{
+	KEY_DEV *dev = NULL;
+	char path[64];
+	char devname[64];
+	int i, fd, clockid, type;
+
+	if (strncmp(name, "event", 5))
+		return -1;
+
+	for (i=0; i<KEY_DEV_MAX; i++) {
+		if (g_keydev[i].src.fd >= 0 && !strcmp(g_keydev[i].name, name))
+			return i;	// already handled
+		if (dev == NULL && g_keydev[i].src.fd < 0)
+			dev = &g_keydev[i];
+	}
+	if (dev == NULL) {
+		ALOGE("[armon] no slot for key device %s\n", name);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", PATH_INPUT, name);
+	fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;	// node not ready yet, IN_ATTRIB brings us back
+
+	memset(devname, 0, sizeof(devname));
+	ioctl(fd, EVIOCGNAME(sizeof(devname) - 1), devname);
+
+	type = key_dev_match(fd, devname);
+	if (type < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// evdev timestamps on the same clock as the telemetry ring
+	clockid = CLOCK_MONOTONIC;
+	ioctl(fd, EVIOCSCLOCKID, &clockid);
+
+	dev->src.fd = fd;
+	dev->src.wakeup = (type == dev_Key);
+	dev->type = type;
+	dev->dropped = 0;
+	dev->frame_cnt = 0;
+	snprintf(dev->name, sizeof(dev->name), "%s", name);
+	if (epoll_add(&dev->src) < 0) {
+		close(fd);
+		dev->src.fd = -1;
+		dev->name[0] = '\0';
+		return -1;
+	}
+
+	ALOGD("[armon] %s device %s (%s) added\n", (type == dev_Light) ? "light" : "key", name, devname);
+	return dev->src.id;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void key_dir_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	char buf[1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	int len, pos, i;
+
+	len = read(src->fd, buf, sizeof(buf));
+	if (len <= 0)
+		return;
+
+	for (pos = 0; pos < len; pos += sizeof(*ev) + ev->len) {
+		ev = (struct inotify_event *)&buf[pos];
+		if (ev->len == 0)
+			continue;
+
+		if (ev->mask & (IN_CREATE | IN_ATTRIB)) {
+			key_dev_open(ev->name);
+		} else if (ev->mask & IN_DELETE) {
+			for (i=0; i<KEY_DEV_MAX; i++) {
+				if (g_keydev[i].src.fd >= 0 && !strcmp(g_keydev[i].name, ev->name))
+					key_dev_close(i);
 			}
 		}
 	}
-	return NULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int key_init(void)
+{
+	DIR *dir;
+	struct dirent *de;
+	int i;
+
+	for (i=0; i<KEY_DEV_MAX; i++) {
+		g_keydev[i].src.id = i;
+		g_keydev[i].src.fd = -1;
+		g_keydev[i].src.handler = key_event;
+		g_keydev[i].name[0] = '\0';
+	}
+
+	// watch first so that a device created during the scan is not missed
+	g_keydir.id = 0;
+	g_keydir.handler = key_dir_event;
+	g_keydir.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (g_keydir.fd < 0) {
+		ALOGE("[armon] inotify_init error, %s\n", strerror(errno));
+		return -1;
+	}
+	if (inotify_add_watch(g_keydir.fd, PATH_INPUT, IN_CREATE | IN_ATTRIB | IN_DELETE) < 0) {
+		ALOGE("[armon] could not watch %s, %s\n", PATH_INPUT, strerror(errno));
+		close(g_keydir.fd);
+		g_keydir.fd = -1;
+		return -1;
+	}
+	if (epoll_add(&g_keydir) < 0)
+		return -1;
+
+	dir = opendir(PATH_INPUT);
+	if (dir == NULL) {
+		ALOGE("[armon] could not open %s, %s\n", PATH_INPUT, strerror(errno));
+		return -1;
+	}
+	while ((de = readdir(dir)) != NULL)
+		key_dev_open(de->d_name);
+	closedir(dir);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void ctl_send(CTL_CLIENT *cli, uint8_t cmd, uint8_t status, uint8_t seq, unsigned int fields)
+{
+	uint8_t buf[ARMON_MSG_MAX];
+	struct armon_msg *msg = (struct armon_msg *)buf;
+	struct armon_field *field = (struct armon_field *)(msg + 1);
+	int id;
+
+	msg->cmd = cmd;
+	msg->count = 0;
+	msg->status = status;
+	msg->seq = seq;
+
+	for (id=0; id<ARMON_FIELD_MAX; id++) {
+		if (!(fields & (1 << id)))
+			continue;
+		field[msg->count].id = id;
+		field[msg->count].reserved = 0;
+		field[msg->count].value = ctl_get(id);
+		msg->count++;
+	}
+
+	// a client that does not drain its socket misses events, it never blocks the loop
+	send(cli->src.fd, buf, sizeof(*msg) + msg->count * sizeof(*field), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// REPLY carrying fd as SCM_RIGHTS, status ARMON_ERR_IO when there is none
+static void ctl_send_fd(CTL_CLIENT *cli, uint8_t seq, int fd)
+{
+	struct armon_msg msg;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	char ctrl[CMSG_SPACE(sizeof(int))];
+
+	msg.cmd = ARMON_CMD_REPLY;
+	msg.count = 0;
+	msg.status = (fd >= 0) ? ARMON_OK : ARMON_ERR_IO;
+	msg.seq = seq;
+
+	iov.iov_base = &msg;
+	iov.iov_len = sizeof(msg);
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		memset(ctrl, 0, sizeof(ctrl));
+		mh.msg_control = ctrl;
+		mh.msg_controllen = sizeof(ctrl);
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	sendmsg(cli->src.fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// push the fields changed during this loop pass, one EVENT per subscriber
+void ctl_flush(void)
+{
+	int i;
+
+	if (!g_changed)
+		return;
+
+	for (i=0; i<CTL_CLIENT_MAX; i++) {
+		if (g_client[i].src.fd >= 0 && (g_client[i].subscribe & g_changed))
+			ctl_send(&g_client[i], ARMON_CMD_EVENT, ARMON_OK, 0, g_client[i].subscribe & g_changed);
+	}
+	g_changed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void ctl_client_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	CTL_CLIENT *cli = &g_client[src->id];
+	uint8_t buf[256];
+	struct armon_msg *msg = (struct armon_msg *)buf;
+	struct armon_field *field = (struct armon_field *)(msg + 1);
+	unsigned int fields = 0;
+	int status = ARMON_OK;
+	int len, i, count;
+
+	len = recv(src->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len <= 0 || (events & (EPOLLHUP | EPOLLERR))) {
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		epoll_del(src);
+		cli->subscribe = 0;
+		return;
+	}
+	if (len < (int)sizeof(*msg))
+		return;
+
+	tlm_event(0);
+
+	if (msg->cmd == ARMON_CMD_TELEMETRY) {
+		ctl_send_fd(cli, msg->seq, g_tlm_fd);
+		return;
+	}
+
+	count = (len - sizeof(*msg)) / sizeof(*field);
+	if (count > msg->count)
+		count = msg->count;
+
+	for (i=0; i<count; i++) {
+		if (field[i].id >= ARMON_FIELD_MAX) {
+			status = ARMON_ERR_FIELD;
+			continue;
+		}
+		fields |= 1 << field[i].id;
+
+		switch (msg->cmd)
+		{
+			case ARMON_CMD_SET:
+				if (ctl_set(field[i].id, field[i].value) < 0)
+					status = ARMON_ERR_IO;
+				break;
+			case ARMON_CMD_SUBSCRIBE:
+				cli->subscribe |= 1 << field[i].id;
+				break;
+			case ARMON_CMD_UNSUBSCRIBE:
+				cli->subscribe &= ~(1 << field[i].id);
+				break;
+			case ARMON_CMD_GET:
+				break;
+			default:
+				status = ARMON_ERR_CMD;
+				break;
+		}
+	}
+
+	ctl_send(cli, ARMON_CMD_REPLY, status, msg->seq, fields);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void ctl_accept_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	int i, fd;
+
+	fd = accept4(src->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	for (i=0; i<CTL_CLIENT_MAX; i++) {
+		if (g_client[i].src.fd < 0) {
+			g_client[i].src.fd = fd;
+			g_client[i].subscribe = 0;
+			if (epoll_add(&g_client[i].src) < 0)
+				break;
+			return;
+		}
+	}
+
+	ALOGE("[armon] control client rejected\n");
+	close(fd);
+	if (i < CTL_CLIENT_MAX)
+		g_client[i].src.fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// socket from init (service option "socket armon seqpacket"), or bound to -s <path> on a host
+int ctl_init(void)
+{
+	struct sockaddr_un addr;
+	int i;
+
+	for (i=0; i<CTL_CLIENT_MAX; i++) {
+		g_client[i].src.id = i;
+		g_client[i].src.fd = -1;
+		g_client[i].src.handler = ctl_client_event;
+		g_client[i].subscribe = 0;
+	}
+
+	g_ctl.id = 0;
+	g_ctl.handler = ctl_accept_event;
+
+	if (g_sock_path == NULL) {
+		g_ctl.fd = android_get_control_socket(ARMON_SOCKET);
+		if (g_ctl.fd < 0) {
+			ALOGE("[armon] no control socket from init\n");
+			return -1;
+		}
+		fcntl(g_ctl.fd, F_SETFL, fcntl(g_ctl.fd, F_GETFL) | O_NONBLOCK);
+	} else {
+		g_ctl.fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (g_ctl.fd < 0)
+			return -1;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", g_sock_path);
+		unlink(g_sock_path);
+
+		if (bind(g_ctl.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			ALOGE("[armon] bind %s error, %s\n", g_sock_path, strerror(errno));
+			close(g_ctl.fd);
+			g_ctl.fd = -1;
+			return -1;
+		}
+	}
+
+	if (listen(g_ctl.fd, CTL_CLIENT_MAX) < 0) {
+		ALOGE("[armon] listen error, %s\n", strerror(errno));
+		close(g_ctl.fd);
+		g_ctl.fd = -1;
+		return -1;
+	}
+	return epoll_add(&g_ctl);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void quit_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	struct signalfd_siginfo info;
+
+	if (read(src->fd, &info, sizeof(info)) != sizeof(info))
+		return;
+
+	ALOGD("[armon] signal %d received\n", info.ssi_signo);
+	g_quit = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// a panel or bridge reset leaves the panel at its probe defaults : put the live state back in one batch
+void panel_reapply(int rebind)
+{
+	// a rebound device has new attribute nodes, skip the failing write on the old fds
+	if (rebind) {
+		dev_close(node_Brightness);
+		dev_close(node_Display);
+		dev_close(node_Rotate);
+	}
+
+	tlm_event(0);
+	dev_wr_status(node_Rotate, g_status.rotate);
+	dev_wr_status(node_Brightness, g_status.brightness);
+	dev_wr_status(node_Display, g_status.display);
+
+	g_reapply_cnt++;
+	ALOGD("[armon] panel state re-applied (%u)\n", g_reapply_cnt);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// NETLINK_KOBJECT_UEVENT without libcutils (its uevent helpers are android only, armon also builds for the host).
+// only kernel messages : port 0, sent by root
+static int uevent_recv(int fd, char *buf, size_t len)
+{
+	struct sockaddr_nl addr;
+	struct iovec iov;
+	char ctrl[CMSG_SPACE(sizeof(struct ucred))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct ucred *cred;
+	int ret;
+
+	for (;;) {
+		iov.iov_base = buf;
+		iov.iov_len = len;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctrl;
+		msg.msg_controllen = sizeof(ctrl);
+
+		ret = recvmsg(fd, &msg, 0);
+		if (ret <= 0)
+			return ret;
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS)
+			continue;
+		cred = (struct ucred *)CMSG_DATA(cmsg);
+		if (cred->uid != 0 || addr.nl_groups == 0 || addr.nl_pid != 0)
+			continue;
+		return ret;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void uevent_event(EPOLL_SOURCE *src, uint32_t events)
+{
+	char buf[UEVENT_MSG_LEN + 2];
+	const char *action, *devpath, *name;
+	int len, pos, reapply = 0, rebind = 0;
+
+	// drain the socket first : one reset sends unbind / bind / add / change together
+	while ((len = uevent_recv(src->fd, buf, UEVENT_MSG_LEN)) > 0) {
+		buf[len] = buf[len + 1] = '\0';
+
+		action = devpath = NULL;
+		for (pos = 0; pos < len; pos += strlen(buf + pos) + 1) {
+			if (!strncmp(buf + pos, "ACTION=", 7))
+				action = buf + pos + 7;
+			else if (!strncmp(buf + pos, "DEVPATH=", 8))
+				devpath = buf + pos + 8;
+		}
+		if (action == NULL || devpath == NULL)
+			continue;
+
+		name = strrchr(devpath, '/');
+		name = name ? name + 1 : devpath;
+		if (strcmp(name, UEVENT_PANEL) && strcmp(name, UEVENT_ARG_IO))
+			continue;
+
+		ALOGD("[armon] uevent %s %s\n", action, name);
+		if (!strcmp(action, "add") || !strcmp(action, "bind")) {
+			reapply = 1;
+			rebind |= !strcmp(name, UEVENT_PANEL);
+		} else if (!strcmp(action, "change")) {
+			reapply = 1;
+		}
+	}
+
+	if (reapply)
+		panel_reapply(rebind);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int uevent_init(void)
+{
+	struct sockaddr_nl addr;
+	int on = 1, size = UEVENT_RCVBUF;
+
+	g_uevent.id = 0;
+	g_uevent.handler = uevent_event;
+	g_uevent.fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (g_uevent.fd < 0) {
+		ALOGE("[armon] uevent socket error, %s\n", strerror(errno));
+		return -1;
+	}
+
+	// FORCE needs CAP_NET_ADMIN, a host run gets the rmem_max limit
+	if (setsockopt(g_uevent.fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+		setsockopt(g_uevent.fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(g_uevent.fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 0xffffffff;
+	if (bind(g_uevent.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ALOGE("[armon] uevent bind error, %s\n", strerror(errno));
+		close(g_uevent.fd);
+		g_uevent.fd = -1;
+		return -1;
+	}
+
+	return epoll_add(&g_uevent);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SIGTERM/SIGINT are taken as epoll events, not as asynchronous handlers
+int quit_init(void)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+		ALOGE("[armon] sigprocmask error, %s\n", strerror(errno));
+		return -1;
+	}
+
+	g_signal.id = 0;
+	g_signal.handler = quit_event;
+	g_signal.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (g_signal.fd < 0) {
+		ALOGE("[armon] signalfd error, %s\n", strerror(errno));
+		return -1;
+	}
+	return epoll_add(&g_signal);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CLOCK_MONOTONIC stops in suspend, CLOCK_BOOTTIME does not : their gap grows by the time suspended
+static int64_t suspend_offset(void)
+{
+	struct timespec mono, boot;
+
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	return (int64_t)(boot.tv_sec - mono.tv_sec) * 1000000000LL + (boot.tv_nsec - mono.tv_nsec);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// a key up can be lost while the SoC suspends : the held key comes from the driver
+void key_resume(void)
+{
+	unsigned char bits[KEY_MAX / 8 + 1];
+	unsigned char held[KEY_MAX / 8 + 1];
+	int i, code;
+
+	memset(held, 0, sizeof(held));
+	for (i=0; i<KEY_DEV_MAX; i++) {
+		if (g_keydev[i].src.fd < 0 || g_keydev[i].type != dev_Key)
+			continue;
+		memset(bits, 0, sizeof(bits));
+		if (ioctl(g_keydev[i].src.fd, EVIOCGKEY(sizeof(bits)), bits) < 0)
+			continue;
+		for (code=0; code<(int)sizeof(held); code++)
+			held[code] |= bits[code];
+	}
+
+	if (held[g_status.key_code / 8] & (1 << (g_status.key_code % 8))) {
+		// still held : repeat from now, not from before the suspend
+		timer_start(tId_Key, TIMEOUT_KEY, 1);
+		return;
+	}
+
+	ALOGD("[armon] key %d released during suspend\n", g_status.key_code);
+	key_release();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// called once per loop wakeup, before any handler
+static void pm_wakeup(struct epoll_event *events, int n)
+{
+	int64_t offset = suspend_offset();
+	int i;
+
+	if (offset - g_pm.offset_ns > SUSPEND_MIN_NS) {
+		g_pm.suspends++;
+		ALOGD("[armon] resumed after %lld ms (suspend %u), suspend blocked %llu us in %u wakeups\n",
+			(long long)(offset - g_pm.offset_ns) / 1000000, g_pm.suspends,
+			(unsigned long long)g_pm.blocked_ns / 1000, g_pm.wakeups);
+		if (is_timer_running(tId_Key))
+			key_resume();
+	}
+	g_pm.offset_ns = offset;
+
+	for (i=0; i<n; i++) {
+		if (((EPOLL_SOURCE *)events[i].data.ptr)->wakeup) {
+			g_pm.wakeups++;
+			g_pm.hold_ns = now_ns();
+			break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// the kernel drops our wakeup source on the next epoll_wait
+static void pm_sleep(void)
+{
+	if (g_pm.hold_ns) {
+		g_pm.blocked_ns += now_ns() - g_pm.hold_ns;
+		g_pm.hold_ns = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void event_loop(void)
+{
+	int i, n;
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+	EPOLL_SOURCE *src;
+
+	while (!g_quit)
+	{
+		pm_sleep();
+
+		// no timeout: the loop only wakes up for key input, a client or an armed timer
+		n = epoll_wait(g_epfd, events, EPOLL_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ALOGE("[armon] epoll_wait error, %s\n", strerror(errno));
+			break;
+		}
+
+		pm_wakeup(events, n);
+
+		for (i=0; i<n; i++) {
+			src = (EPOLL_SOURCE *)events[i].data.ptr;
+			if (src->fd >= 0)
+				src->handler(src, events[i].events);
+		}
+
+		ctl_flush();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// early stage : put the panel and codec back to the saved state, no property or /data access
+void status_init(void)
+{
+	STATE_FILE st;
+	uint64_t start = now_ns();
+	struct timespec boot;
+
+	g_status.auto_override = 0;
+	g_status.auto_filter = -1;
+	g_status.auto_level = -1;
+
+	if (state_load(&st) == 0) {
+		g_state_loaded = 1;
+
+		g_status.brightness = g_status.manual_brightness = st.brightness;
+		g_status.volume = st.volume;
+		g_status.rotate = st.rotate;
+		g_status.auto_mode = st.auto_mode ? 1 : 0;
+		// a panel left off must not look like a dead unit after power-on
+		g_status.display = 1;
+
+		dev_wr_status(node_Brightness, g_status.brightness);
+		dev_wr_status(node_Volume, g_status.volume);
+		dev_wr_status(node_Rotate, g_status.rotate);
+		dev_wr_status(node_Display, g_status.display);
+		if (g_status.auto_mode)
+			light_enable(1);
+	} else {
+		// nothing saved : track what the drivers came up with
+		g_status.brightness = dev_rd_status(node_Brightness);
+		if (g_status.brightness < 0)
+			g_status.brightness = BRIGHTNESS_DEFAULT;
+		g_status.manual_brightness = g_status.brightness;
+
+		g_status.volume = dev_rd_status(node_Volume);
+		if (g_status.volume < 0)
+			g_status.volume = VOLUME_DEFAULT;
+
+		g_status.display = dev_rd_status(node_Display);
+		if (g_status.display < 0)
+			g_status.display = 1;
+		g_status.rotate = 0;
+		g_status.auto_mode = 0;
+	}
+
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+	ALOGD("[armon] state %s in %llu us (boot +%ld ms)\n", g_state_loaded ? "restored" : "not found",
+		(unsigned long long)(now_ns() - start) / 1000, boot.tv_sec * 1000 + boot.tv_nsec / 1000000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// fault the stack the loop will use in now, mlockall keeps it resident
+static void stack_prefault(void)
+{
+	volatile char buf[STACK_PREFAULT];
+
+	memset((char *)buf, 0, sizeof(buf));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// low-latency profile, applied once everything the loop needs is allocated and opened
+void sched_init(void)
+{
+	struct sched_param param;
+	struct sched_attr_uclamp attr;
+	struct armon_tlm_profile prof = { -1, 0, 0, 0 };	// what was applied
+	cpu_set_t set;
+
+	if (g_sched_cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(g_sched_cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			ALOGE("[armon] affinity cpu%d error, %s\n", g_sched_cpu, strerror(errno));
+		else
+			prof.cpu = g_sched_cpu;
+	}
+
+	if (g_sched_prio > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = g_sched_prio;
+		if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0)
+			ALOGE("[armon] SCHED_FIFO %d error, %s\n", g_sched_prio, strerror(errno));
+		else
+			prof.fifo_prio = g_sched_prio;
+	} else if (g_sched_uclamp > 0) {
+		// CFS with a utilization floor, still bounded by the cgroup cpu.uclamp.max
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_OTHER;
+		attr.sched_flags = SCHED_FLAG_KEEP_PARAMS | SCHED_FLAG_UTIL_CLAMP_MIN;
+		attr.sched_util_min = g_sched_uclamp;
+		if (syscall(__NR_sched_setattr, 0, &attr, 0) < 0)
+			ALOGE("[armon] uclamp.min %d error, %s\n", g_sched_uclamp, strerror(errno));
+		else
+			prof.uclamp_min = g_sched_uclamp;
+	}
+
+	if (g_sched_lock) {
+		stack_prefault();
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+			ALOGE("[armon] mlockall error, %s\n", strerror(errno));
+		else
+			prof.mlock = 1;
+	}
+
+	if (g_tlm)
+		g_tlm->profile = prof;
+
+	ALOGD("[armon] profile : cpu %d, fifo %d, uclamp %d, lock %d\n",
+		g_sched_cpu, g_sched_prio, g_sched_uclamp, g_sched_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int prop_get(const char *key, char *buf)
+{
+	// -p : nothing mounts /data on a host, persist_wait would poll tId_Boot for the whole run
+	if (g_props_ready && !strcmp(key, PROP_PERSIST_READY))
+		return snprintf(buf, PROP_LEN + 1, "true");
+	return property_get(key, buf, NULL);
+}
+
+// device backend of libarmon
+static const ARMON_OPS g_sys_ops = {
+	.node_write		= dev_wr_status,
+	.prop_get		= prop_get,
+	.prop_set		= persist_write,
+	.timer_start	= timer_start,
+	.timer_stop		= timer_stop,
+	.timer_running	= is_timer_running,
+	.light_enable	= light_enable,
+	.state_save		= state_save,
+};
+
 int main(int argc, char *argv[])
 {
-	pthread_t key_handle;
-	char buf[PROPERTY_VALUE_MAX+1];	
-	char *arg_v = argv[0];
-	int arg_c = argc;
+	int i, opt;
 
-	memset(&g_status, 0, sizeof(g_status)); 
+	armon_core_init(&g_sys_ops);
+	memset(&g_pm, 0, sizeof(g_pm));
+	g_pm.offset_ns = suspend_offset();
 
-	ALOGD("[armon] deamon service start");
+	tlm_init();
 
-	if (property_get("persist.prazen.brightness", buf, NULL)) {
-		dev_wr_status("brightness", PATH_PANEL, ar_atoi(buf));
+	while ((opt = getopt(argc, argv, "r:s:n:f:c:P:u:Lp")) != -1) {
+		switch (opt)
+		{
+			case 'r':	g_root = optarg;		break;	// sysfs root prefix
+			case 's':	g_sock_path = optarg;	break;	// control socket path
+			case 'n':	g_key_filter = optarg;	break;	// key device name
+			case 'f':	g_state_path = optarg;	break;	// state file
+			case 'c':	g_sched_cpu = atoi(optarg);		break;	// pin to cpu
+			case 'P':	g_sched_prio = atoi(optarg);	break;	// SCHED_FIFO priority
+			case 'u':	g_sched_uclamp = atoi(optarg);	break;	// uclamp.min
+			case 'L':	g_sched_lock = 1;		break;	// lock memory
+			case 'p':	g_props_ready = 1;		break;	// persist properties ready from the start
+			default:
+				fprintf(stderr, "usage: %s [-r sysfs_root] [-s socket_path] [-n key_device_name] [-f state_file]"
+					" [-c cpu] [-P fifo_prio] [-u uclamp_min] [-L] [-p]\n", argv[0]);
+				return -1;
+		}
 	}
-/*
-	if (property_get("persist.prazen.volume", buf, NULL)) {
-		dev_wr_status("volume", PATH_AUDIO, ar_atoi(buf));
+
+	ALOGD("[armon] deamon service start");
+
+	for (i=0; i<node_Max; i++)
+		dev_open(i);
+
+	status_init();
+
+	g_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (g_epfd < 0) {
+		ALOGE("[armon] epoll_create error, %s\n", strerror(errno));
+		return -1;
 	}
-*/
 
-	pthread_create(&key_handle, NULL, keyevent_thread, NULL);
+	if (timer_init() < 0)
+		return -1;
+
+	if (quit_init() < 0)
+		return -1;
+
+	key_init();
+
+	ctl_init();
+
+	uevent_init();
+
+	persist_wait();
+
+	sched_init();
 
-	timer_init();
+	event_loop();
 
-	while(1) sleep(10);
+	// stopped by init (shutdown / stop armon) : nothing pending may be lost
+	tlm_event(0);
+	persist_flush();
+	ALOGD("[armon] deamon service stop, %u suspends, suspend blocked %llu us in %u wakeups",
+		g_pm.suspends, (unsigned long long)g_pm.blocked_ns / 1000, g_pm.wakeups);
+	ALOGD("[armon] timer delay : %llu expiries, avg %llu us, max %llu us",
+		(unsigned long long)g_sched[ARMON_TLM_SCHED_TIMER].count,
+		g_sched[ARMON_TLM_SCHED_TIMER].count ?
+			(unsigned long long)(g_sched[ARMON_TLM_SCHED_TIMER].total_ns / g_sched[ARMON_TLM_SCHED_TIMER].count / 1000) : 0,
+		(unsigned long long)g_sched[ARMON_TLM_SCHED_TIMER].max_ns / 1000);
 
 	return 0;
 }
@@ -0,0 +1,520 @@
+/*
+ *  armon_core.c - armon key / panel state machine (libarmon)
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  No file, property or timer access here : see ARMON_OPS in armon_core.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cutils/log.h"
+
+#include "armon_ctl.h"
+#include "armon_core.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+SYS_STATUS			g_status;
+IO_STAT				g_io;
+unsigned int		g_changed;
+int					g_state_loaded = 0;
+int					g_persist_ready = 0;
+
+static const ARMON_OPS	*g_ops;
+static const int	g_auto_curve_default[AUTO_LEVELS] = { 4, 10, 20, 30, 45, 65, 90, BRIGHTNESS_LIMIT };
+static int			g_auto_curve[AUTO_LEVELS];
+static int			g_auto_override_ms = TIMEOUT_OVERRIDE;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void armon_core_init(const ARMON_OPS *ops)
+{
+	g_ops = ops;
+
+	memset(&g_status, 0, sizeof(g_status));
+	memset(&g_io, 0, sizeof(g_io));
+	g_changed = 0;
+	g_state_loaded = 0;
+	g_persist_ready = 0;
+	memcpy(g_auto_curve, g_auto_curve_default, sizeof(g_auto_curve));
+	g_auto_override_ms = TIMEOUT_OVERRIDE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+int ar_atoi(char *s)
+{
+        int k = 0;
+
+        k = 0;
+        while (*s != '\0' && *s >= '0' && *s <= '9') {
+                k = 10 * k + (*s - '0');
+                s++;
+        }
+        return k;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// g_status holds the live values; persist properties are written behind by tId_Persist
+void persist_mark(int flag)
+{
+	g_status.dirty |= flag;
+	g_ops->timer_start(tId_Persist, TIMEOUT_PERSIST, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void persist_flush(void)
+{
+	g_ops->timer_stop(tId_Persist);
+
+	if (!g_status.dirty)
+		return;
+
+	g_ops->state_save();
+
+	// before /data the properties stay dirty, persist_attach() flushes them
+	if (!g_persist_ready) {
+		g_status.dirty &= DIRTY_PROPS;
+		return;
+	}
+
+	if (g_status.dirty & DIRTY_VOLUME)
+		g_ops->prop_set(PROP_VOLUME, ARMON_FIELD_VOLUME, g_status.volume);
+	if (g_status.dirty & DIRTY_BRIGHTNESS)
+		g_ops->prop_set(PROP_BRIGHTNESS, ARMON_FIELD_BRIGHTNESS, g_status.manual_brightness);
+	if (g_status.dirty & DIRTY_AUTO)
+		g_ops->prop_set(PROP_AUTO, ARMON_FIELD_AUTO_BRIGHTNESS, g_status.auto_mode);
+	g_status.dirty = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int persist_load(const char *key, int def)
+{
+	char buf[PROP_LEN+1];
+
+	if (g_ops->prop_get(key, buf) > 0)
+		return ar_atoi(buf);
+	return def;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int set_volume(int level)
+{
+	int ret = g_ops->node_write(node_Volume, level);
+	g_status.volume = level;
+	persist_mark(DIRTY_VOLUME);
+	g_changed |= 1 << ARMON_FIELD_VOLUME;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int get_volume(void)
+{
+	return g_status.volume;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int set_brightness(int value)
+{
+	int ret;
+	ALOGD("[armon] set brightness = %d\n", value);
+	ret = g_ops->node_write(node_Brightness, value);
+	g_status.brightness = value;
+	g_status.manual_brightness = value;
+	persist_mark(DIRTY_BRIGHTNESS);
+	auto_override();
+	g_changed |= 1 << ARMON_FIELD_BRIGHTNESS;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int get_brightness(void)
+{
+	return g_status.brightness;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int set_display(int on)
+{
+	int ret;
+	ALOGD("[armon] set display = %d\n", on);
+	ret = g_ops->node_write(node_Display, on);
+	g_status.display = on;
+	persist_mark(DIRTY_STATE);
+	g_changed |= 1 << ARMON_FIELD_DISPLAY;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int set_rotate(int flip)
+{
+	int ret;
+	ALOGD("[armon] set rotate = %d\n", flip);
+	ret = g_ops->node_write(node_Rotate, flip);
+	g_status.rotate = flip;
+	persist_mark(DIRTY_STATE);
+	g_changed |= 1 << ARMON_FIELD_ROTATE;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// brightness chosen by the ALS : not persisted, the persisted value stays the manual one
+static void auto_apply(int level)
+{
+	int value = g_auto_curve[level];
+
+	g_status.auto_level = level;
+	if (value == g_status.brightness)
+		return;
+
+	ALOGD("[armon] auto brightness = %d (level %d)\n", value, level);
+	g_ops->node_write(node_Brightness, value);
+	g_status.brightness = value;
+	g_changed |= 1 << ARMON_FIELD_BRIGHTNESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// one exponential filter step toward the last ALS bucket, then move the panel only once the filtered value is
+// clearly in another bucket. The input core drops repeated values, a step change is one event : tId_Light keeps
+// feeding the last bucket until the filter reached it
+static void auto_filter(void)
+{
+	int target = g_status.auto_index << 8;
+	int diff;
+
+	g_status.auto_filter += (target - g_status.auto_filter) >> AUTO_FILTER_SHIFT;
+
+	// the shift stalls short of the target
+	diff = target - g_status.auto_filter;
+	if (diff > -(1 << AUTO_FILTER_SHIFT) && diff < (1 << AUTO_FILTER_SHIFT))
+		g_status.auto_filter = target;
+
+	if (g_status.auto_filter == target)
+		g_ops->timer_stop(tId_Light);
+	else if (!g_ops->timer_running(tId_Light))
+		g_ops->timer_start(tId_Light, TIMEOUT_LIGHT, 1);
+
+	if (g_status.auto_override)
+		return;
+
+	if (g_status.auto_level >= 0) {
+		diff = g_status.auto_filter - (g_status.auto_level << 8);
+		if (diff < 0)
+			diff = -diff;
+		if (diff < 128 + AUTO_HYSTERESIS)
+			return;
+	}
+	auto_apply((g_status.auto_filter + 128) >> 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// new ALS bucket
+void auto_sample(int index)
+{
+	if (!g_status.auto_mode)
+		return;
+
+	index = index < 0 ? 0 : (index >= AUTO_LEVELS ? AUTO_LEVELS - 1 : index);
+
+	g_status.auto_index = index;
+	if (g_status.auto_filter < 0)
+		g_status.auto_filter = index << 8;
+	auto_filter();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// a manual brightness change suspends auto mode for g_auto_override_ms
+void auto_override(void)
+{
+	if (!g_status.auto_mode)
+		return;
+
+	g_status.auto_override = 1;
+	g_ops->timer_start(tId_Auto, g_auto_override_ms, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void auto_resume(void)
+{
+	g_status.auto_override = 0;
+	g_status.auto_level = -1;
+	if (g_status.auto_mode && g_status.auto_filter >= 0)
+		auto_apply((g_status.auto_filter + 128) >> 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int set_auto(int on)
+{
+	ALOGD("[armon] set auto brightness = %d\n", on);
+
+	g_ops->timer_stop(tId_Auto);
+	g_ops->timer_stop(tId_Light);
+	g_status.auto_mode = on;
+	g_status.auto_override = 0;
+	g_status.auto_filter = -1;
+	g_status.auto_level = -1;
+
+	// the sensor only polls while someone listens
+	g_ops->light_enable(on);
+
+	if (!on && g_status.brightness != g_status.manual_brightness) {
+		g_ops->node_write(node_Brightness, g_status.manual_brightness);
+		g_status.brightness = g_status.manual_brightness;
+		g_changed |= 1 << ARMON_FIELD_BRIGHTNESS;
+	}
+
+	persist_mark(DIRTY_AUTO);
+	g_changed |= 1 << ARMON_FIELD_AUTO_BRIGHTNESS;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// curve and override time are persist properties, read once /data is up
+void auto_config(void)
+{
+	char buf[PROP_LEN+1];
+	char *p, *end;
+	int curve[AUTO_LEVELS];
+	int i;
+
+	if (g_ops->prop_get(PROP_AUTO_CURVE, buf) > 0) {
+		for (i = 0, p = buf; i < AUTO_LEVELS; i++, p = end + 1) {
+			curve[i] = strtol(p, &end, 10);
+			if (end == p || curve[i] < 0 || curve[i] > BRIGHTNESS_LIMIT || (*end != ',' && i < AUTO_LEVELS - 1))
+				break;
+		}
+		if (i == AUTO_LEVELS)
+			memcpy(g_auto_curve, curve, sizeof(curve));
+		else
+			ALOGE("[armon] bad %s \"%s\", default curve used\n", PROP_AUTO_CURVE, buf);
+	}
+
+	g_auto_override_ms = persist_load(PROP_AUTO_OVERRIDE, TIMEOUT_OVERRIDE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// /data is up and the persist properties are loaded
+void persist_attach(void)
+{
+	int value;
+
+	g_persist_ready = 1;
+	ALOGD("[armon] persist properties attached\n");
+
+	if (g_state_loaded) {
+		// the state file is at least as recent as the properties : bring them in line
+		if (persist_load(PROP_BRIGHTNESS, -1) != g_status.manual_brightness)
+			g_status.dirty |= DIRTY_BRIGHTNESS;
+		if (persist_load(PROP_VOLUME, -1) != g_status.volume)
+			g_status.dirty |= DIRTY_VOLUME;
+		if (persist_load(PROP_AUTO, 0) != g_status.auto_mode)
+			g_status.dirty |= DIRTY_AUTO;
+	} else {
+		// no state file yet (first start) : the properties are the saved state
+		value = persist_load(PROP_BRIGHTNESS, -1);
+		if (value >= 0 && value != g_status.manual_brightness) {
+			g_status.manual_brightness = value;
+			if (!g_status.auto_mode) {
+				g_ops->node_write(node_Brightness, value);
+				g_status.brightness = value;
+				g_changed |= 1 << ARMON_FIELD_BRIGHTNESS;
+			}
+		}
+		value = persist_load(PROP_VOLUME, -1);
+		if (value >= 0 && value != g_status.volume) {
+			g_ops->node_write(node_Volume, value);
+			g_status.volume = value;
+			g_changed |= 1 << ARMON_FIELD_VOLUME;
+		}
+		if ((persist_load(PROP_AUTO, 0) ? 1 : 0) != g_status.auto_mode)
+			set_auto(!g_status.auto_mode);
+		g_status.dirty |= DIRTY_STATE;
+	}
+
+	auto_config();
+
+	if (g_status.dirty)
+		persist_mark(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// armon starts before /data : poll for the persist properties only until they are loaded
+void persist_wait(void)
+{
+	char buf[PROP_LEN+1];
+
+	if (g_ops->prop_get(PROP_PERSIST_READY, buf) > 0 && !strcmp(buf, "true")) {
+		g_ops->timer_stop(tId_Boot);
+		persist_attach();
+	} else if (!g_ops->timer_running(tId_Boot)) {
+		g_ops->timer_start(tId_Boot, TIMEOUT_BOOT, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void key_step(int key_code)
+{
+	g_io.steps++;
+	g_io.press_steps++;
+
+	switch (key_code)
+	{
+		case KEY_VOLUME_UP:
+			if (g_status.volume < VOLUME_MAX) {
+				set_volume(get_volume() + 1);
+			}
+			break;
+
+		case KEY_VOLUME_DOWN:
+			if (g_status.volume > 0) {
+				set_volume(get_volume() - 1);
+			}
+			break;
+
+		// brightness may come from the auto curve : anywhere in 0 .. BRIGHTNESS_LIMIT
+		case KEY_BRIGHTNESS_UP:
+			if (g_status.brightness < BRIGHTNESS_LIMIT) {
+				set_brightness(get_brightness() + BRIGHTNESS_STEP > BRIGHTNESS_LIMIT ?
+					BRIGHTNESS_LIMIT : get_brightness() + BRIGHTNESS_STEP);
+			}
+			break;
+
+		case KEY_BRIGHTNESS_DOWN:
+			if (g_status.brightness > BRIGHTNESS_KEY_MIN) {
+				set_brightness(get_brightness() - BRIGHTNESS_STEP < BRIGHTNESS_KEY_MIN ?
+					BRIGHTNESS_KEY_MIN : get_brightness() - BRIGHTNESS_STEP);
+			}
+			break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void timer_handler(int id)
+{
+	switch (id)
+	{
+		case tId_Key:
+			if (g_status.long_tick < LONGKEY_CNT)
+			{
+				g_status.long_tick++;
+			}
+			else
+			{
+				key_step(g_status.key_code);
+			}
+			break;
+
+		case tId_Persist:
+			persist_flush();
+			break;
+
+		case tId_Auto:
+			auto_resume();
+			break;
+
+		case tId_Boot:
+			persist_wait();
+			break;
+
+		case tId_Light:
+			if (g_status.auto_mode && g_status.auto_filter >= 0)
+				auto_filter();
+			else
+				g_ops->timer_stop(tId_Light);
+			break;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// only the _KEY_DATA keys, a matched device may report power, back or media keys as well
+int key_handled(int code)
+{
+	switch (code)
+	{
+		case KEY_VOLUME_DOWN:
+		case KEY_VOLUME_UP:
+		case KEY_BRIGHTNESS_DOWN:
+		case KEY_BRIGHTNESS_UP:
+			return 1;
+	}
+	return 0;
+}
+
+void key_process(int code, int value)
+{
+	if (!key_handled(code))
+		return;
+
+	g_status.key_code = code;
+
+	// key up
+	if (value == 0) {
+		key_release();
+
+		ALOGD("[armon] key code = %d\n", code);
+		key_step(code);
+
+		ALOGD("[armon] key %d : %u steps, %u syscalls (%u per step)\n", code,
+			g_io.press_steps, g_io.press_calls, g_io.press_calls / g_io.press_steps);
+		g_io.press_steps = 0;
+		g_io.press_calls = 0;
+	} else { // key down
+		if (!g_ops->timer_running(tId_Key)) {
+			g_io.press_steps = 0;
+			g_io.press_calls = 0;
+			g_ops->timer_start(tId_Key, TIMEOUT_KEY, 1);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void key_release(void)
+{
+	if (g_ops->timer_running(tId_Key)) {
+		g_status.long_tick = 0;
+		g_ops->timer_stop(tId_Key);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int ctl_get(int id)
+{
+	switch (id)
+	{
+		case ARMON_FIELD_BRIGHTNESS:	return g_status.brightness;
+		case ARMON_FIELD_VOLUME:		return g_status.volume;
+		case ARMON_FIELD_DISPLAY:		return g_status.display;
+		case ARMON_FIELD_ROTATE:		return g_status.rotate;
+		case ARMON_FIELD_AUTO_BRIGHTNESS:	return g_status.auto_mode;
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// clamp and apply one field, an unchanged value never reaches sysfs
+int ctl_set(int id, int value)
+{
+	switch (id)
+	{
+		case ARMON_FIELD_BRIGHTNESS:
+			value = value < 0 ? 0 : (value > BRIGHTNESS_LIMIT ? BRIGHTNESS_LIMIT : value);
+			return (value == g_status.brightness) ? 0 : set_brightness(value);
+
+		case ARMON_FIELD_VOLUME:
+			value = value < 0 ? 0 : (value > VOLUME_MAX ? VOLUME_MAX : value);
+			return (value == g_status.volume) ? 0 : set_volume(value);
+
+		case ARMON_FIELD_DISPLAY:
+			value = value ? 1 : 0;
+			return (value == g_status.display) ? 0 : set_display(value);
+
+		case ARMON_FIELD_ROTATE:
+			value = value < 0 ? 0 : (value > 3 ? 3 : value);
+			return (value == g_status.rotate) ? 0 : set_rotate(value);
+
+		case ARMON_FIELD_AUTO_BRIGHTNESS:
+			value = value ? 1 : 0;
+			return (value == g_status.auto_mode) ? 0 : set_auto(value);
+	}
+	return -1;
+}
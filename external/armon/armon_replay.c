@@ -0,0 +1,523 @@
+/*
+ *  armon_replay.c - armon key trace replay benchmark
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  Starts armon against a temporary sysfs tree, replays recorded key
+ *  traces through a uinput device and reports per trace :
+ *    - key to sysfs write latency (from armon's telemetry ring)
+ *    - armon CPU time, read/write io calls and wakeups (/proc/<pid>)
+ *    - with -S, every syscall armon makes, counted by a ptrace tracer.
+ *      The tracer stops armon twice per syscall : the latency and cpu
+ *      columns of a -S run are not comparable with a plain run
+ *
+ *  usage : armon_replay [-S] [-a armon_path] trace...
+ *          armon_replay -R /dev/input/eventX > trace	(record)
+ *
+ *  trace format, one event per line :
+ *    <ms after previous event> <key code> <value 1:down 0:up>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "armon_ctl.h"
+#include "armon_tlm.h"
+
+#define REPLAY_DEV_NAME		"armon-replay"
+#define TRACE_MAX			4096
+#define SETTLE_MS			300		// armon start-up / device discovery
+#define TAIL_MS				2500	// covers the persist write-behind delay
+
+typedef struct
+{
+	int			delay;		// ms after previous event
+	int			code;
+	int			value;
+}TRACE_EVENT;
+
+typedef struct
+{
+	unsigned long long	cpu_ticks;		// utime + stime
+	unsigned long long	syscr;			// read-class io calls (/proc/<pid>/io)
+	unsigned long long	syscw;			// write-class io calls
+	unsigned long long	wakeups;		// voluntary context switches
+	unsigned long long	syscalls;		// every syscall, -S only
+}PROC_STAT;
+
+// shared with the tracer process
+typedef struct
+{
+	pid_t				pid;			// armon
+	unsigned long long	syscalls;		// syscall entries seen
+}SYS_COUNT;
+
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO		0x420e	// linux 5.3
+#define PTRACE_SYSCALL_INFO_ENTRY	1
+#endif
+
+static const int g_keys[] = { KEY_VOLUMEDOWN, KEY_VOLUMEUP, KEY_BRIGHTNESSDOWN, KEY_BRIGHTNESSUP };
+static SYS_COUNT *g_count;		// -S
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int trace_load(const char *path, TRACE_EVENT *ev)
+{
+	char line[128];
+	FILE *fp;
+	int n = 0;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "open %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+	while (n < TRACE_MAX && fgets(line, sizeof(line), fp)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%d %d %d", &ev[n].delay, &ev[n].code, &ev[n].value) == 3)
+			n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// dump EV_KEY events of a real device in trace format until interrupted
+static int trace_record(const char *dev)
+{
+	struct input_event ev[64];
+	uint64_t last = 0, t;
+	int fd, n, i;
+
+	fd = open(dev, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "open %s : %s\n", dev, strerror(errno));
+		return 1;
+	}
+
+	printf("# recorded from %s : <ms after previous> <code> <value>\n", dev);
+	while ((n = read(fd, ev, sizeof(ev))) > 0) {
+		for (i=0; i<n / (int)sizeof(ev[0]); i++) {
+			if (ev[i].type != EV_KEY || ev[i].value == 2)
+				continue;
+			t = (uint64_t)ev[i].time.tv_sec * 1000 + ev[i].time.tv_usec / 1000;
+			printf("%llu %d %d\n", last ? (unsigned long long)(t - last) : 0ULL, ev[i].code, ev[i].value);
+			fflush(stdout);
+			last = t;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int uinput_open(void)
+{
+	struct uinput_user_dev dev;
+	unsigned int i;
+	int fd;
+
+	fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "open /dev/uinput : %s\n", strerror(errno));
+		return -1;
+	}
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	for (i=0; i<sizeof(g_keys)/sizeof(g_keys[0]); i++)
+		ioctl(fd, UI_SET_KEYBIT, g_keys[i]);
+
+	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.name, sizeof(dev.name), "%s", REPLAY_DEV_NAME);
+	dev.id.bustype = BUS_VIRTUAL;
+
+	if (write(fd, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd, UI_DEV_CREATE) < 0) {
+		fprintf(stderr, "uinput create : %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void uinput_key(int fd, int code, int value)
+{
+	struct input_event ev[2];
+
+	memset(ev, 0, sizeof(ev));
+	ev[0].type = EV_KEY;
+	ev[0].code = code;
+	ev[0].value = value;
+	ev[1].type = EV_SYN;
+	ev[1].code = SYN_REPORT;
+	if (write(fd, ev, sizeof(ev)) != sizeof(ev))
+		fprintf(stderr, "uinput write : %s\n", strerror(errno));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int fake_sysfs(const char *root)
+{
+	static const char *nodes[] = {
+		"/sys/bus/i2c/devices/3-004c/group_brightness",
+		"/sys/bus/i2c/devices/3-004c/group_display",
+		"/sys/bus/i2c/devices/3-004c/group_rotate",
+		"/sys/bus/i2c/devices/1-0038/volume",
+	};
+	static const char *dirs[] = {
+		"/sys", "/sys/bus", "/sys/bus/i2c", "/sys/bus/i2c/devices",
+		"/sys/bus/i2c/devices/3-004c", "/sys/bus/i2c/devices/1-0038",
+	};
+	char path[256];
+	unsigned int i;
+	FILE *fp;
+
+	for (i=0; i<sizeof(dirs)/sizeof(dirs[0]); i++) {
+		snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+		mkdir(path, 0755);
+	}
+	for (i=0; i<sizeof(nodes)/sizeof(nodes[0]); i++) {
+		snprintf(path, sizeof(path), "%s%s", root, nodes[i]);
+		fp = fopen(path, "w");
+		if (fp == NULL)
+			return -1;
+		fprintf(fp, "%-8d", 1);		// wide enough for pwrite at offset 0
+		fclose(fp);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void proc_stat(pid_t pid, PROC_STAT *st)
+{
+	char path[64], line[512];
+	unsigned long long utime = 0, stime = 0;
+	FILE *fp;
+	char *p;
+
+	memset(st, 0, sizeof(*st));
+	if (g_count)
+		st->syscalls = __atomic_load_n(&g_count->syscalls, __ATOMIC_RELAXED);
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	fp = fopen(path, "r");
+	if (fp) {
+		// fields after the ')' of comm : state(3) ... utime(14) stime(15)
+		if (fgets(line, sizeof(line), fp) && (p = strrchr(line, ')')) != NULL)
+			sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime);
+		fclose(fp);
+	}
+	st->cpu_ticks = utime + stime;
+
+	snprintf(path, sizeof(path), "/proc/%d/io", pid);
+	fp = fopen(path, "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp)) {
+			sscanf(line, "syscr: %llu", &st->syscr);
+			sscanf(line, "syscw: %llu", &st->syscw);
+		}
+		fclose(fp);
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	fp = fopen(path, "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp))
+			sscanf(line, "voluntary_ctxt_switches: %llu", &st->wakeups);
+		fclose(fp);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// -S : runs in its own process between armon_replay and armon, counts armon's syscall entries into g_count
+static void sys_tracer(char *const argv[])
+{
+	struct { uint8_t op; uint8_t pad[7]; uint64_t rest[10]; } info;
+	int status, sig;
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+		_exit(1);
+
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+	g_count->pid = pid;
+	ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+	while (waitpid(pid, &status, 0) == pid) {
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			_exit(0);
+
+		sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+			if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, (void *)sizeof(info), &info) > 0 &&
+				info.op == PTRACE_SYSCALL_INFO_ENTRY)
+				__atomic_fetch_add(&g_count->syscalls, 1, __ATOMIC_RELAXED);
+		} else if (WSTOPSIG(status) != SIGTRAP) {
+			sig = WSTOPSIG(status);		// signal-delivery-stop, pass it on
+		}
+		ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig);
+	}
+	_exit(1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// armon on the fake sysfs, *armon_pid : armon itself (the tracer is in between with -S)
+static pid_t armon_start(const char *armon, const char *root, const char *sock_path, pid_t *armon_pid)
+{
+	char state_path[128];
+	// -p : no tId_Boot poll, the persist write-behind runs as on a booted device
+	char *argv[] = { (char *)armon, "-r", (char *)root, "-s", (char *)sock_path, "-f", state_path,
+					"-n", REPLAY_DEV_NAME, "-p", NULL };
+	pid_t pid;
+	int i;
+
+	// the state file would otherwise be /metadata/armon/state of the host
+	snprintf(state_path, sizeof(state_path), "%s/state", root);
+
+	if (g_count)
+		memset(g_count, 0, sizeof(*g_count));
+
+	pid = fork();
+	if (pid == 0) {
+		if (g_count)
+			sys_tracer(argv);
+		execv(armon, argv);
+		_exit(127);
+	}
+	*armon_pid = pid;
+
+	if (g_count && pid > 0) {
+		for (i = 0; i < 200 && __atomic_load_n(&g_count->pid, __ATOMIC_ACQUIRE) == 0; i++)
+			usleep(10000);
+		*armon_pid = g_count->pid ? g_count->pid : pid;
+	}
+	return pid;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int ctl_connect(const char *path, int wait_ms)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	for (; wait_ms > 0; wait_ms -= 10) {
+		sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (sock < 0)
+			return -1;
+		if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			return sock;
+		close(sock);
+		usleep(10000);
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static const struct armon_tlm *tlm_map(int sock)
+{
+	struct armon_msg msg;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	char ctrl[CMSG_SPACE(sizeof(int))];
+	const struct armon_tlm *tlm;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd = ARMON_CMD_TELEMETRY;
+	if (send(sock, &msg, sizeof(msg), 0) != sizeof(msg))
+		return NULL;
+
+	iov.iov_base = &msg;
+	iov.iov_len = sizeof(msg);
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl;
+	mh.msg_controllen = sizeof(ctrl);
+	if (recvmsg(sock, &mh, MSG_CMSG_CLOEXEC) < (int)sizeof(msg) || msg.status != ARMON_OK)
+		return NULL;
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+		return NULL;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	tlm = mmap(NULL, sizeof(*tlm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return (tlm == MAP_FAILED) ? NULL : tlm;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int run_trace(const char *armon, const char *name, const TRACE_EVENT *ev, int n)
+{
+	char root[] = "/tmp/armon_replay.XXXXXX";
+	char sock_path[128];
+	static uint64_t lat[ARMON_TLM_SIZE];
+	const struct armon_tlm *tlm;
+	PROC_STAT st0, st1;
+	uint64_t t, head, i;
+	int ufd, sock, status, cnt = 0, props = 0, errors = 0;
+	long hz = sysconf(_SC_CLK_TCK);
+	pid_t pid, apid;
+	char sys[24];
+
+	if (mkdtemp(root) == NULL || fake_sysfs(root) < 0) {
+		fprintf(stderr, "fake sysfs : %s\n", strerror(errno));
+		return -1;
+	}
+	snprintf(sock_path, sizeof(sock_path), "%s/armon.sock", root);
+
+	ufd = uinput_open();
+	if (ufd < 0)
+		return -1;
+
+	pid = armon_start(armon, root, sock_path, &apid);
+
+	sock = ctl_connect(sock_path, 2000);
+	tlm = (sock >= 0) ? tlm_map(sock) : NULL;
+	if (tlm == NULL) {
+		fprintf(stderr, "%s : armon did not come up\n", name);
+		kill(apid, SIGKILL);
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		close(ufd);
+		return -1;
+	}
+	usleep(SETTLE_MS * 1000);
+
+	head = tlm->head;
+	proc_stat(apid, &st0);
+
+	t = now_ns();
+	for (i=0; i<(uint64_t)n; i++) {
+		t += (uint64_t)ev[i].delay * 1000000ULL;
+		sleep_until(t);
+		uinput_key(ufd, ev[i].code, ev[i].value);
+	}
+	usleep(TAIL_MS * 1000);
+
+	proc_stat(apid, &st1);
+
+	for (i = head; i < tlm->head && cnt < ARMON_TLM_SIZE; i++) {
+		const struct armon_tlm_rec *rec = &tlm->rec[i & (ARMON_TLM_SIZE - 1)];
+		if (rec->error)
+			errors++;
+		if (rec->kind == ARMON_TLM_PROPERTY)
+			props++;
+		else
+			lat[cnt++] = rec->done_ns - rec->event_ns;
+	}
+	qsort(lat, cnt, sizeof(uint64_t), cmp_u64);
+
+	if (g_count)
+		snprintf(sys, sizeof(sys), "%llu", st1.syscalls - st0.syscalls);
+	else
+		snprintf(sys, sizeof(sys), "-");
+
+	printf("%-20s %5d %6d %5d %5d %9.3f %9.3f %8.1f %8llu %8s %8llu\n", name, n, cnt, props, errors,
+		cnt ? lat[cnt / 2] / 1e6 : 0.0, cnt ? lat[(cnt * 99) / 100] / 1e6 : 0.0,
+		(st1.cpu_ticks - st0.cpu_ticks) * 1000.0 / hz,
+		st1.syscr + st1.syscw - st0.syscr - st0.syscw, sys, st1.wakeups - st0.wakeups);
+
+	kill(apid, SIGTERM);
+	waitpid(pid, &status, 0);
+	munmap((void *)tlm, sizeof(*tlm));
+	close(sock);
+	ioctl(ufd, UI_DEV_DESTROY);
+	close(ufd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static TRACE_EVENT ev[TRACE_MAX];
+	const char *armon = "armon";
+	const char *name;
+	int opt, n, ret = 0;
+
+	while ((opt = getopt(argc, argv, "a:R:S")) != -1) {
+		switch (opt)
+		{
+			case 'a':	armon = optarg;					break;
+			case 'R':	return trace_record(optarg);
+			case 'S':
+				g_count = mmap(NULL, sizeof(*g_count), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+				if (g_count == MAP_FAILED)
+					return 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-S] [-a armon_path] trace...\n"
+								"       %s -R /dev/input/eventX > trace\n", argv[0], argv[0]);
+				return 1;
+		}
+	}
+
+	printf("%-20s %5s %6s %5s %5s %9s %9s %8s %8s %8s %8s\n", "trace", "keys", "writes", "props",
+		"errs", "p50(ms)", "p99(ms)", "cpu(ms)", "rw-io", "syscalls", "wakeups");
+
+	for (; optind < argc; optind++) {
+		name = strrchr(argv[optind], '/');
+		name = name ? name + 1 : argv[optind];
+
+		n = trace_load(argv[optind], ev);
+		if (n <= 0 || run_trace(armon, name, ev, n) < 0)
+			ret = 1;
+	}
+	return ret;
+}
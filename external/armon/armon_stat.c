@@ -0,0 +1,263 @@
+/*
+ *  armon_stat.c - armon telemetry reader
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  Maps armon's telemetry ring read-only and prints the latency
+ *  distribution of the control writes recorded in it, and the scheduling
+ *  delay of armon's loop under its current profile.
+ *
+ *  usage : armon_stat [-s socket_path]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "armon_ctl.h"
+#include "armon_tlm.h"
+
+#define HIST_BUCKETS		24		// log2 buckets of microseconds
+
+typedef enum
+{
+	lat_Total,			// event -> write done
+	lat_Dispatch,		// event -> handler start
+	lat_Write,			// handler start -> write done
+	lat_Max
+}_LAT_ID;
+
+static const char *g_kind_name[ARMON_TLM_KIND_MAX] = { "sysfs", "property" };
+static const char *g_field_name[ARMON_FIELD_MAX] = { "brightness", "volume", "display", "rotate", "auto" };
+static const char *g_lat_name[lat_Max] = { "event->done", "event->dispatch", "dispatch->done" };
+static const char *g_sched_name[ARMON_TLM_SCHED_MAX] = { "timer", "input" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int tlm_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	struct armon_msg msg;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	char ctrl[CMSG_SPACE(sizeof(int))];
+	int sock, fd = -1;
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "connect %s : %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd = ARMON_CMD_TELEMETRY;
+	if (send(sock, &msg, sizeof(msg), 0) != sizeof(msg))
+		goto out;
+
+	iov.iov_base = &msg;
+	iov.iov_len = sizeof(msg);
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl;
+	mh.msg_controllen = sizeof(ctrl);
+
+	if (recvmsg(sock, &mh, MSG_CMSG_CLOEXEC) < (int)sizeof(msg) || msg.status != ARMON_OK) {
+		fprintf(stderr, "armon has no telemetry ring\n");
+		goto out;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+out:
+	close(sock);
+	return fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// copy the live records out of the ring, skipping the ones torn by the producer
+static int tlm_snapshot(const struct armon_tlm *tlm, struct armon_tlm_rec *out)
+{
+	uint64_t head, start, i;
+	uint32_t seq;
+	int n = 0;
+
+	head = __atomic_load_n(&tlm->head, __ATOMIC_ACQUIRE);
+	start = (head > ARMON_TLM_SIZE) ? head - ARMON_TLM_SIZE : 0;
+
+	for (i = start; i < head; i++) {
+		const struct armon_tlm_rec *rec = &tlm->rec[i & (ARMON_TLM_SIZE - 1)];
+
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(&out[n], rec, sizeof(*rec));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+		n++;
+	}
+	return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static uint64_t lat_of(const struct armon_tlm_rec *rec, int id)
+{
+	switch (id)
+	{
+		case lat_Total:		return rec->done_ns - rec->event_ns;
+		case lat_Dispatch:	return rec->dispatch_ns - rec->event_ns;
+		default:			return rec->done_ns - rec->dispatch_ns;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void print_hist(const uint64_t *lat, int n)
+{
+	int hist[HIST_BUCKETS];
+	int i, b, peak = 1;
+
+	memset(hist, 0, sizeof(hist));
+	for (i=0; i<n; i++) {
+		uint64_t us = lat[i] / 1000;
+		for (b = 0; b < HIST_BUCKETS - 1 && us >= (1ULL << b); b++)
+			;
+		hist[b]++;
+	}
+	for (b=0; b<HIST_BUCKETS; b++)
+		if (hist[b] > peak)
+			peak = hist[b];
+
+	for (b=0; b<HIST_BUCKETS; b++) {
+		if (!hist[b])
+			continue;
+		printf("      < %8llu us %6d |%.*s\n", 1ULL << b, hist[b], hist[b] * 40 / peak,
+			"########################################");
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void print_group(const struct armon_tlm_rec *rec, int n, int kind, int field, uint64_t *lat)
+{
+	unsigned long long bytes = 0;
+	int errors = 0, cnt, i, id;
+
+	for (id = 0; id < lat_Max; id++) {
+		cnt = 0;
+		for (i=0; i<n; i++) {
+			if (rec[i].kind != kind || rec[i].source != field)
+				continue;
+			lat[cnt++] = lat_of(&rec[i], id);
+			if (id == lat_Total) {
+				bytes += rec[i].bytes;
+				errors += rec[i].error ? 1 : 0;
+			}
+		}
+		if (cnt == 0)
+			return;
+
+		if (id == lat_Total)
+			printf("%s %s : %d writes, %llu bytes, %d errors\n",
+				g_kind_name[kind], g_field_name[field], cnt, bytes, errors);
+
+		qsort(lat, cnt, sizeof(uint64_t), cmp_u64);
+		printf("  %-16s p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", g_lat_name[id],
+			lat[cnt / 2] / 1e6, lat[(cnt * 99) / 100] / 1e6, lat[cnt - 1] / 1e6);
+		if (id == lat_Total)
+			print_hist(lat, cnt);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void print_sched(const struct armon_tlm *tlm)
+{
+	const struct armon_tlm_profile *prof = &tlm->profile;
+	uint64_t count, total, max;
+	int i;
+
+	printf("profile : cpu %d, fifo %d, uclamp.min %d, mlock %d\n",
+		prof->cpu, prof->fifo_prio, prof->uclamp_min, prof->mlock);
+
+	for (i = 0; i < ARMON_TLM_SCHED_MAX; i++) {
+		count = __atomic_load_n(&tlm->sched[i].count, __ATOMIC_RELAXED);
+		total = __atomic_load_n(&tlm->sched[i].total_ns, __ATOMIC_RELAXED);
+		max = __atomic_load_n(&tlm->sched[i].max_ns, __ATOMIC_RELAXED);
+		printf("  %-6s delay : %llu wakeups, avg %.3f ms, max %.3f ms\n", g_sched_name[i],
+			(unsigned long long)count, count ? total / 1e6 / count : 0.0, max / 1e6);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = ARMON_SOCKET_PATH;
+	struct armon_tlm_rec *rec;
+	const struct armon_tlm *tlm;
+	uint64_t *lat;
+	int opt, fd, n, kind, field;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt)
+		{
+			case 's':	path = optarg;	break;
+			default:
+				fprintf(stderr, "usage: %s [-s socket_path]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	fd = tlm_connect(path);
+	if (fd < 0)
+		return 1;
+
+	tlm = mmap(NULL, sizeof(*tlm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (tlm == MAP_FAILED) {
+		fprintf(stderr, "mmap : %s\n", strerror(errno));
+		return 1;
+	}
+	if (tlm->magic != ARMON_TLM_MAGIC || tlm->version != ARMON_TLM_VERSION ||
+		tlm->rec_size != sizeof(struct armon_tlm_rec)) {
+		fprintf(stderr, "telemetry ring version mismatch\n");
+		return 1;
+	}
+
+	rec = calloc(ARMON_TLM_SIZE, sizeof(*rec));
+	lat = calloc(ARMON_TLM_SIZE, sizeof(*lat));
+	if (rec == NULL || lat == NULL)
+		return 1;
+
+	print_sched(tlm);
+
+	n = tlm_snapshot(tlm, rec);
+	printf("%d records (%llu produced)\n", n, (unsigned long long)tlm->head);
+
+	for (kind = 0; kind < ARMON_TLM_KIND_MAX; kind++)
+		for (field = 0; field < ARMON_FIELD_MAX; field++)
+			print_group(rec, n, kind, field, lat);
+
+	free(rec);
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ *  armon_core.h - armon key / panel state machine
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  libarmon holds the policy of armon : key long-press / repeat, value
+ *  clamping, auto brightness and the persistence policy. Every side effect
+ *  goes through the ARMON_OPS backend bound by armon_core_init(), the
+ *  daemon binds sysfs / timerfd / properties, a host harness binds fakes.
+ */
+#ifndef _ARMON_CORE_H_
+#define _ARMON_CORE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VOLUME_MAX			(15)
+#define VOLUME_DEFAULT		(12)	// 80%
+#define VOLUME_RATIO		(4)	// 2dB
+#define VOLUME_LEVEL		(((VOLUME_MAX-1)*VOLUME_RATIO) - 1)
+
+#define BRIGHTNESS_MAX		(4)
+#define BRIGHTNESS_DEFAULT	(64)	// mid range, on the BRIGHTNESS_STEP grid
+#define BRIGHTNESS_LIMIT	(0x7A)	// panel register limit
+#define BRIGHTNESS_STEP		(8)		// per key step, BRIGHTNESS_KEY_MIN .. BRIGHTNESS_LIMIT in 15 steps
+#define BRIGHTNESS_KEY_MIN	(BRIGHTNESS_STEP)	// keys never blank the panel (level 0), display off does
+
+#define LONGKEY_CNT			10	// 1sec
+#define REPEAT_CNT			3	// 3sec
+
+typedef enum
+{	
+	KEY_VOLUME_DOWN = 114,		// Volume down
+	KEY_VOLUME_UP,				// Volume up
+	KEY_BRIGHTNESS_DOWN	= 224,	// Brightness down
+	KEY_BRIGHTNESS_UP,			// Brightness up
+}_KEY_DATA;
+ 
+typedef enum
+{
+	tId_Key,
+	tId_Persist,
+	tId_Auto,
+	tId_Boot,
+	tId_Light,
+	tId_Max
+}_TIMER_ID;
+
+#define TIMEOUT_TS		10000//15000
+#define TIMEOUT_KEY		100
+#define TIMEOUT_PERSIST	2000	// write-behind delay after the last change
+#define TIMEOUT_OVERRIDE	30000	// manual brightness holds off auto mode for this long
+#define TIMEOUT_BOOT		250		// persist property poll, boot only
+#define TIMEOUT_LIGHT		200		// ALS filter tick, only until the filter settled
+
+#define PROP_VOLUME			"persist.prazen.volume"
+#define PROP_BRIGHTNESS		"persist.prazen.brightness"
+#define PROP_AUTO			"persist.prazen.auto.brightness"	// 0 / 1
+#define PROP_AUTO_CURVE		"persist.prazen.auto.curve"			// brightness per lux bucket, "b0,b1,...,b7"
+#define PROP_AUTO_OVERRIDE	"persist.prazen.auto.override"		// manual override, ms
+#define PROP_PERSIST_READY	"ro.persistent_properties.ready"
+
+#define DIRTY_VOLUME		(1 << 0)
+#define DIRTY_BRIGHTNESS	(1 << 1)
+#define DIRTY_AUTO			(1 << 2)
+#define DIRTY_STATE			(1 << 3)	// state file only (display, rotate)
+#define DIRTY_PROPS			(DIRTY_VOLUME | DIRTY_BRIGHTNESS | DIRTY_AUTO)
+#define PROP_LEN			92		// PROPERTY_VALUE_MAX
+
+#define AUTO_LEVELS			8		// ALS buckets (ls_rpr0521 light_report_value)
+#define AUTO_FILTER_SHIFT	2		// exponential filter weight 1/4 per sample / tick
+#define AUTO_HYSTERESIS		64		// Q8, a quarter bucket past the midpoint
+
+typedef enum
+{
+	node_Brightness,
+	node_Volume,
+	node_Display,
+	node_Rotate,
+	node_Max
+}_NODE_ID;
+
+typedef struct
+{
+	int			sleep;			// sleep status
+	int			mode;			// mode
+	int			cnt;
+	int			delay;
+	int			long_tick;		// long key check
+	int			repeat_tick;	// repeat key check
+	int			key_code	;	// key code
+	int			volume;			// volume
+	int			brightness;		// brightness
+	int			display;		// panel display on/off
+	int			rotate;			// panel flip
+	int			manual_brightness;	// last brightness set by keys / clients
+	int			auto_mode;		// ambient light brightness
+	int			auto_override;	// manual brightness holds auto mode off
+	int			auto_filter;	// filtered ALS bucket, Q8 (-1 : no sample yet)
+	int			auto_index;		// last ALS bucket, fed to the filter every TIMEOUT_LIGHT
+	int			auto_level;		// bucket applied to the panel (-1 : none)
+	int			dirty;			// values not yet persisted
+}SYS_STATUS;
+
+// syscall accounting for the key path
+typedef struct
+{
+	unsigned int	calls;			// syscalls issued since start
+	unsigned int	steps;			// value steps applied since start
+	unsigned int	press_calls;	// syscalls of the current key press
+	unsigned int	press_steps;	// steps of the current key press
+}IO_STAT;
+
+// I/O backend
+typedef struct
+{
+	int		(*node_write)(int id, int value);				// _NODE_ID, 0 / -1
+	int		(*prop_get)(const char *key, char *buf);		// buf of PROP_LEN+1, returns length
+	void	(*prop_set)(const char *key, int field, int value);
+	int		(*timer_start)(int id, int delay, int repeat);	// _TIMER_ID, ms
+	void	(*timer_stop)(int id);
+	int		(*timer_running)(int id);
+	void	(*light_enable)(int on);						// ALS polling
+	void	(*state_save)(void);							// early state file
+}ARMON_OPS;
+
+extern SYS_STATUS	g_status;
+extern IO_STAT		g_io;
+extern unsigned int	g_changed;			// ARMON_FIELD bits changed since the last ctl_flush
+extern int			g_state_loaded;		// live values came from the state file
+extern int			g_persist_ready;	// persist properties loaded (/data mounted)
+
+void armon_core_init(const ARMON_OPS *ops);
+
+int ar_atoi(char *s);
+
+int set_volume(int level);
+int get_volume(void);
+int set_brightness(int value);
+int get_brightness(void);
+int set_display(int on);
+int set_rotate(int flip);
+int set_auto(int on);
+
+int ctl_get(int id);
+int ctl_set(int id, int value);
+
+int key_handled(int code);
+void key_step(int key_code);
+void key_process(int code, int value);
+void key_release(void);
+void timer_handler(int id);
+
+void auto_sample(int index);
+void auto_override(void);
+void auto_resume(void);
+void auto_config(void);
+
+void persist_mark(int flag);
+void persist_flush(void);
+int persist_load(const char *key, int def);
+void persist_attach(void);
+void persist_wait(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//_ARMON_CORE_H_
@@ -0,0 +1,70 @@
+/*
+ *  armon_ctl.h - armon control socket protocol
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  armon is the only writer of the panel / codec control nodes. Clients
+ *  connect to the SOCK_SEQPACKET socket ARMON_SOCKET (/dev/socket/armon),
+ *  every packet is one armon_msg header followed by 'count' armon_field.
+ *
+ *  GET       : fields to read (value ignored)     -> REPLY with values
+ *  SET       : fields to write, applied as a batch -> REPLY with values
+ *  SUBSCRIBE : fields to watch (value ignored)     -> REPLY, then EVENT on change
+ *  UNSUBSCRIBE : fields to stop watching           -> REPLY
+ *  TELEMETRY : no field                            -> REPLY, armon_tlm.h ring fd as SCM_RIGHTS
+ */
+#ifndef _ARMON_CTL_H_
+#define _ARMON_CTL_H_
+
+#include <stdint.h>
+
+#define ARMON_SOCKET			"armon"
+#define ARMON_SOCKET_PATH		"/dev/socket/" ARMON_SOCKET
+
+typedef enum
+{
+	ARMON_CMD_GET = 1,
+	ARMON_CMD_SET,
+	ARMON_CMD_SUBSCRIBE,
+	ARMON_CMD_UNSUBSCRIBE,
+	ARMON_CMD_TELEMETRY,
+	ARMON_CMD_REPLY = 0x80,
+	ARMON_CMD_EVENT,
+} ARMON_CMD;
+
+typedef enum
+{
+	ARMON_FIELD_BRIGHTNESS,
+	ARMON_FIELD_VOLUME,
+	ARMON_FIELD_DISPLAY,		// 0 : off, 1 : on
+	ARMON_FIELD_ROTATE,			// 0 : normal, 1 : horizontal, 2 : vertical, 3 : both
+	ARMON_FIELD_AUTO_BRIGHTNESS,	// 0 : manual, 1 : ambient light
+	ARMON_FIELD_MAX
+} ARMON_FIELD;
+
+typedef enum
+{
+	ARMON_OK = 0,
+	ARMON_ERR_CMD,				// unknown command
+	ARMON_ERR_FIELD,			// unknown field id
+	ARMON_ERR_IO,				// control node write failed
+} ARMON_STATUS;
+
+struct armon_msg
+{
+	uint8_t		cmd;
+	uint8_t		count;			// number of armon_field following
+	uint8_t		status;			// ARMON_STATUS, replies only
+	uint8_t		seq;			// echoed in the reply
+} __attribute__((packed));
+
+struct armon_field
+{
+	uint8_t		id;				// ARMON_FIELD
+	uint8_t		reserved;
+	int16_t		value;
+} __attribute__((packed));
+
+#define ARMON_MSG_MAX			(sizeof(struct armon_msg) + ARMON_FIELD_MAX * sizeof(struct armon_field))
+
+#endif	//_ARMON_CTL_H_
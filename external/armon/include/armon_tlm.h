@@ -0,0 +1,84 @@
+/*
+ *  armon_tlm.h - armon telemetry ring
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  armon (single producer) appends one record per control write to a ring
+ *  in a sealed memfd. Readers get the fd with ARMON_CMD_TELEMETRY on the
+ *  control socket, map it read-only (F_SEAL_FUTURE_WRITE : a writable map
+ *  fails) and never block the producer:
+ *
+ *  - rec.seq is odd while the slot is written, a reader drops a record
+ *    whose seq changed or is odd (torn by the producer lapping it).
+ *  - head counts produced records, slot = index & (ARMON_TLM_SIZE - 1).
+ *  - sched[] / profile describe the event loop itself : how late it runs
+ *    after a wakeup source fired, under the scheduling profile it runs
+ *    with (-P / -u / -c / -L). Each counter is a single 64-bit store.
+ *
+ *  All times are CLOCK_MONOTONIC nanoseconds.
+ */
+#ifndef _ARMON_TLM_H_
+#define _ARMON_TLM_H_
+
+#include <stdint.h>
+
+#define ARMON_TLM_MAGIC			0x544d5241	// "ARMT"
+#define ARMON_TLM_VERSION		2
+#define ARMON_TLM_SIZE			1024		// records, power of 2
+
+typedef enum
+{
+	ARMON_TLM_SYSFS,			// control node write, source = ARMON_FIELD
+	ARMON_TLM_PROPERTY,			// persist property write, source = ARMON_FIELD
+	ARMON_TLM_KIND_MAX
+} ARMON_TLM_KIND;
+
+typedef enum
+{
+	ARMON_TLM_SCHED_TIMER,		// timerfd expiry -> handler
+	ARMON_TLM_SCHED_INPUT,		// evdev timestamp -> key handler (a key that woke the device includes the resume)
+	ARMON_TLM_SCHED_MAX
+} ARMON_TLM_SCHED;
+
+struct armon_tlm_sched
+{
+	uint64_t	count;
+	uint64_t	total_ns;
+	uint64_t	max_ns;
+};
+
+// scheduling profile armon runs with, -1 / 0 : not set
+struct armon_tlm_profile
+{
+	int32_t		cpu;			// -c, pinned cpu
+	int32_t		fifo_prio;		// -P, SCHED_FIFO priority
+	int32_t		uclamp_min;		// -u, CFS uclamp.min
+	int32_t		mlock;			// -L, memory locked
+};
+
+struct armon_tlm_rec
+{
+	uint32_t	seq;			// odd while written
+	uint8_t		kind;			// ARMON_TLM_KIND
+	uint8_t		source;			// ARMON_FIELD
+	uint16_t	bytes;			// bytes written
+	int32_t		error;			// 0 or errno
+	int32_t		value;			// value written
+	uint64_t	event_ns;		// evdev timestamp / request arrival
+	uint64_t	dispatch_ns;	// handler start
+	uint64_t	done_ns;		// write completion
+};
+
+struct armon_tlm
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	size;			// ARMON_TLM_SIZE
+	uint32_t	rec_size;		// sizeof(struct armon_tlm_rec)
+	uint64_t	head;			// records produced
+	struct armon_tlm_sched		sched[ARMON_TLM_SCHED_MAX];
+	struct armon_tlm_profile	profile;
+	struct armon_tlm_rec		rec[ARMON_TLM_SIZE];
+};
+
+#endif	//_ARMON_TLM_H_
@@ -0,0 +1,109 @@
+/*
+ *  armon_core_benchmark.cpp - libarmon hot path benchmarks
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  Cost of the policy alone, with a backend that does no I/O : the key
+ *  step / repeat path, a client SET and an ALS sample.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "armon_ctl.h"
+#include "armon_core.h"
+
+namespace {
+
+int null_node_write(int id, int value) { return 0; }
+int null_prop_get(const char *key, char *buf) { return 0; }
+void null_prop_set(const char *key, int field, int value) {}
+int g_timer_run[tId_Max];
+int null_timer_start(int id, int delay, int repeat) { g_timer_run[id] = 1; return 0; }
+void null_timer_stop(int id) { g_timer_run[id] = 0; }
+int null_timer_running(int id) { return g_timer_run[id]; }
+void null_light_enable(int on) {}
+void null_state_save(void) {}
+
+const ARMON_OPS g_null_ops = {
+	null_node_write,
+	null_prop_get,
+	null_prop_set,
+	null_timer_start,
+	null_timer_stop,
+	null_timer_running,
+	null_light_enable,
+	null_state_save,
+};
+
+void Init()
+{
+	armon_core_init(&g_null_ops);
+	g_status.auto_filter = -1;
+	g_status.auto_level = -1;
+}
+
+}	// namespace
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// one repeat tick of a held volume key, bouncing between the limits
+static void BM_KeyRepeat(benchmark::State &state)
+{
+	int code = KEY_VOLUME_UP;
+
+	Init();
+	key_process(code, 1);
+	g_status.long_tick = LONGKEY_CNT;
+	for (auto _ : state) {
+		timer_handler(tId_Key);
+		if (g_status.volume == VOLUME_MAX || g_status.volume == 0) {
+			code = (code == KEY_VOLUME_UP) ? KEY_VOLUME_DOWN : KEY_VOLUME_UP;
+			g_status.key_code = code;
+		}
+	}
+}
+BENCHMARK(BM_KeyRepeat);
+
+// key down + key up, one step
+static void BM_KeyPress(benchmark::State &state)
+{
+	int code = KEY_BRIGHTNESS_UP;
+
+	Init();
+	for (auto _ : state) {
+		key_process(code, 1);
+		key_process(code, 0);
+		if (g_status.brightness == BRIGHTNESS_LIMIT || g_status.brightness == 0)
+			code = (code == KEY_BRIGHTNESS_UP) ? KEY_BRIGHTNESS_DOWN : KEY_BRIGHTNESS_UP;
+	}
+}
+BENCHMARK(BM_KeyPress);
+
+// client SET : a changed value and a no-op one
+static void BM_CtlSet(benchmark::State &state)
+{
+	int value = 0;
+
+	Init();
+	for (auto _ : state) {
+		ctl_set(ARMON_FIELD_BRIGHTNESS, value);
+		ctl_set(ARMON_FIELD_BRIGHTNESS, value);
+		value = (value + 1) % (BRIGHTNESS_LIMIT + 1);
+	}
+}
+BENCHMARK(BM_CtlSet);
+
+// ALS sample through the filter and the hysteresis
+static void BM_AutoSample(benchmark::State &state)
+{
+	int index = 0;
+
+	Init();
+	set_auto(1);
+	for (auto _ : state) {
+		auto_sample(index);
+		index = (index + 1) % AUTO_LEVELS;
+	}
+}
+BENCHMARK(BM_AutoSample);
+
+BENCHMARK_MAIN();
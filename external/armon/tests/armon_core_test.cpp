@@ -0,0 +1,352 @@
+/*
+ *  armon_core_test.cpp - libarmon unit tests
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *  libarmon runs against a fake ARMON_OPS backend : node writes and
+ *  properties land in arrays, timers only fire when a test calls
+ *  timer_handler().
+ */
+
+#include <map>
+#include <string>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "armon_ctl.h"
+#include "armon_core.h"
+
+namespace {
+
+struct FakeBackend
+{
+	int		node[node_Max];
+	int		node_writes[node_Max];
+	bool	timer_run[tId_Max];
+	int		timer_delay[tId_Max];
+	int		light;
+	int		saves;
+	std::map<std::string, std::string>	props;
+	std::map<std::string, int>			prop_writes;
+};
+
+FakeBackend *g_fake;
+
+int fake_node_write(int id, int value)
+{
+	g_fake->node[id] = value;
+	g_fake->node_writes[id]++;
+	return 0;
+}
+
+int fake_prop_get(const char *key, char *buf)
+{
+	auto it = g_fake->props.find(key);
+	if (it == g_fake->props.end())
+		return 0;
+	snprintf(buf, PROP_LEN + 1, "%s", it->second.c_str());
+	return strlen(buf);
+}
+
+void fake_prop_set(const char *key, int field, int value)
+{
+	g_fake->props[key] = std::to_string(value);
+	g_fake->prop_writes[key]++;
+}
+
+int fake_timer_start(int id, int delay, int repeat)
+{
+	g_fake->timer_run[id] = true;
+	g_fake->timer_delay[id] = delay;
+	return 0;
+}
+
+void fake_timer_stop(int id)
+{
+	g_fake->timer_run[id] = false;
+}
+
+int fake_timer_running(int id)
+{
+	return g_fake->timer_run[id];
+}
+
+void fake_light_enable(int on)
+{
+	g_fake->light = on;
+}
+
+void fake_state_save(void)
+{
+	g_fake->saves++;
+}
+
+const ARMON_OPS g_fake_ops = {
+	fake_node_write,
+	fake_prop_get,
+	fake_prop_set,
+	fake_timer_start,
+	fake_timer_stop,
+	fake_timer_running,
+	fake_light_enable,
+	fake_state_save,
+};
+
+class ArmonCoreTest : public ::testing::Test
+{
+protected:
+	FakeBackend fake;
+
+	void SetUp() override
+	{
+		memset(fake.node, 0, sizeof(fake.node));
+		memset(fake.node_writes, 0, sizeof(fake.node_writes));
+		memset(fake.timer_run, 0, sizeof(fake.timer_run));
+		memset(fake.timer_delay, 0, sizeof(fake.timer_delay));
+		fake.light = 0;
+		fake.saves = 0;
+		g_fake = &fake;
+		armon_core_init(&g_fake_ops);
+		g_status.auto_filter = -1;
+		g_status.auto_level = -1;
+	}
+
+	// fire a running timer the way the daemon's timerfd would
+	void Fire(int id)
+	{
+		ASSERT_TRUE(fake.timer_run[id]);
+		timer_handler(id);
+	}
+
+	void Press(int code, int repeats)
+	{
+		key_process(code, 1);
+		for (int i = 0; i < LONGKEY_CNT + repeats; i++)
+			Fire(tId_Key);
+		key_process(code, 0);
+	}
+};
+
+}	// namespace
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_F(ArmonCoreTest, CtlSetClampsAndSkipsUnchanged)
+{
+	EXPECT_EQ(0, ctl_set(ARMON_FIELD_BRIGHTNESS, 500));
+	EXPECT_EQ(BRIGHTNESS_LIMIT, fake.node[node_Brightness]);
+	EXPECT_EQ(1, fake.node_writes[node_Brightness]);
+
+	// already there : no sysfs write
+	ctl_set(ARMON_FIELD_BRIGHTNESS, BRIGHTNESS_LIMIT);
+	EXPECT_EQ(1, fake.node_writes[node_Brightness]);
+
+	ctl_set(ARMON_FIELD_VOLUME, -3);
+	EXPECT_EQ(0, g_status.volume);
+	EXPECT_EQ(0, fake.node_writes[node_Volume]);
+
+	ctl_set(ARMON_FIELD_ROTATE, 7);
+	EXPECT_EQ(3, fake.node[node_Rotate]);
+	ctl_set(ARMON_FIELD_DISPLAY, 5);
+	EXPECT_EQ(1, fake.node[node_Display]);
+
+	EXPECT_EQ(-1, ctl_set(ARMON_FIELD_MAX, 1));
+	EXPECT_EQ(-1, ctl_get(ARMON_FIELD_MAX));
+}
+
+TEST_F(ArmonCoreTest, ShortPressStepsOnce)
+{
+	set_volume(5);
+	key_process(KEY_VOLUME_UP, 1);
+	EXPECT_TRUE(fake.timer_run[tId_Key]);
+	key_process(KEY_VOLUME_UP, 0);
+
+	EXPECT_FALSE(fake.timer_run[tId_Key]);
+	EXPECT_EQ(6, g_status.volume);
+	EXPECT_EQ(6, fake.node[node_Volume]);
+}
+
+TEST_F(ArmonCoreTest, ForeignKeysAreIgnored)
+{
+	// KEY_POWER, KEY_BACK, KEY_PLAYPAUSE : inside 114 .. 225, not armon keys
+	const int foreign[] = { 116, 158, 164 };
+
+	set_volume(5);
+	for (int code : foreign) {
+		key_process(code, 1);
+		EXPECT_FALSE(fake.timer_run[tId_Key]);
+		EXPECT_EQ(0, g_status.key_code);
+		key_process(code, 0);
+	}
+	EXPECT_EQ(5, g_status.volume);
+	EXPECT_EQ(0, fake.node_writes[node_Brightness]);
+}
+
+TEST_F(ArmonCoreTest, LongPressRepeatsAfterLongKeyCount)
+{
+	set_volume(2);
+	key_process(KEY_VOLUME_UP, 1);
+	for (int i = 0; i < LONGKEY_CNT; i++)
+		Fire(tId_Key);
+	EXPECT_EQ(2, g_status.volume);
+
+	Fire(tId_Key);
+	Fire(tId_Key);
+	EXPECT_EQ(4, g_status.volume);
+
+	key_process(KEY_VOLUME_UP, 0);
+	EXPECT_EQ(5, g_status.volume);
+}
+
+TEST_F(ArmonCoreTest, VolumeStopsAtLimits)
+{
+	set_volume(VOLUME_MAX);
+	Press(KEY_VOLUME_UP, 3);
+	EXPECT_EQ(VOLUME_MAX, g_status.volume);
+
+	set_volume(0);
+	Press(KEY_VOLUME_DOWN, 3);
+	EXPECT_EQ(0, g_status.volume);
+}
+
+TEST_F(ArmonCoreTest, PersistIsWrittenBehind)
+{
+	g_persist_ready = 1;
+	set_volume(7);
+	set_volume(8);
+	EXPECT_TRUE(fake.timer_run[tId_Persist]);
+	EXPECT_EQ(0, fake.prop_writes[PROP_VOLUME]);
+
+	Fire(tId_Persist);
+	EXPECT_EQ(1, fake.prop_writes[PROP_VOLUME]);
+	EXPECT_EQ("8", fake.props[PROP_VOLUME]);
+	EXPECT_EQ(1, fake.saves);
+	EXPECT_EQ(0, g_status.dirty);
+}
+
+TEST_F(ArmonCoreTest, PropertiesWaitForData)
+{
+	set_volume(9);
+	Fire(tId_Persist);
+	EXPECT_EQ(1, fake.saves);
+	EXPECT_EQ(0, fake.prop_writes[PROP_VOLUME]);
+	EXPECT_TRUE(g_status.dirty & DIRTY_VOLUME);
+
+	fake.props[PROP_PERSIST_READY] = "true";
+	g_state_loaded = 1;
+	persist_wait();
+	Fire(tId_Persist);
+	EXPECT_EQ("9", fake.props[PROP_VOLUME]);
+}
+
+TEST_F(ArmonCoreTest, AutoCurveFollowsSensor)
+{
+	set_auto(1);
+	EXPECT_EQ(1, fake.light);
+
+	auto_sample(3);
+	EXPECT_EQ(30, fake.node[node_Brightness]);
+	EXPECT_EQ(3, g_status.auto_level);
+
+	// auto brightness is not persisted as the manual value
+	EXPECT_EQ(0, g_status.manual_brightness);
+
+	set_auto(0);
+	EXPECT_EQ(0, fake.light);
+	EXPECT_EQ(0, fake.node[node_Brightness]);
+}
+
+TEST_F(ArmonCoreTest, ManualBrightnessOverridesAuto)
+{
+	set_auto(1);
+	auto_sample(2);
+	ctl_set(ARMON_FIELD_BRIGHTNESS, 50);
+	EXPECT_TRUE(g_status.auto_override);
+	EXPECT_TRUE(fake.timer_run[tId_Auto]);
+
+	// samples keep filtering but do not move the panel while overridden
+	auto_sample(6);
+	EXPECT_EQ(50, fake.node[node_Brightness]);
+
+	Fire(tId_Auto);
+	EXPECT_FALSE(g_status.auto_override);
+	EXPECT_NE(50, fake.node[node_Brightness]);
+}
+
+TEST_F(ArmonCoreTest, AutoConfigRejectsBadCurve)
+{
+	fake.props[PROP_AUTO_CURVE] = "1,2,3";
+	auto_config();
+	set_auto(1);
+	auto_sample(0);
+	EXPECT_EQ(4, fake.node[node_Brightness]);
+
+	fake.props[PROP_AUTO_CURVE] = "5,6,7,8,9,10,11,12";
+	auto_config();
+	set_auto(0);
+	set_auto(1);
+	auto_sample(0);
+	EXPECT_EQ(5, fake.node[node_Brightness]);
+}
+
+TEST_F(ArmonCoreTest, AutoFilterSettlesAfterOneEvent)
+{
+	set_auto(1);
+	auto_sample(2);
+	EXPECT_EQ(20, fake.node[node_Brightness]);
+
+	// a step change arrives as a single ABS_MISC event, the repeats are dropped by the input core
+	auto_sample(5);
+	EXPECT_TRUE(fake.timer_run[tId_Light]);
+	EXPECT_EQ(TIMEOUT_LIGHT, fake.timer_delay[tId_Light]);
+
+	for (int i = 0; i < 64 && fake.timer_run[tId_Light]; i++)
+		Fire(tId_Light);
+	EXPECT_FALSE(fake.timer_run[tId_Light]);
+	EXPECT_EQ(5 << 8, g_status.auto_filter);
+	EXPECT_EQ(5, g_status.auto_level);
+	EXPECT_EQ(65, fake.node[node_Brightness]);
+
+	// and back down
+	auto_sample(0);
+	for (int i = 0; i < 64 && fake.timer_run[tId_Light]; i++)
+		Fire(tId_Light);
+	EXPECT_EQ(0, g_status.auto_level);
+	EXPECT_EQ(4, fake.node[node_Brightness]);
+
+	set_auto(0);
+	EXPECT_FALSE(fake.timer_run[tId_Light]);
+}
+
+TEST_F(ArmonCoreTest, BrightnessKeysOverrideAutoAboveVolumeRange)
+{
+	set_auto(1);
+	auto_sample(6);
+	EXPECT_EQ(90, fake.node[node_Brightness]);
+
+	Press(KEY_BRIGHTNESS_UP, 0);
+	EXPECT_EQ(90 + BRIGHTNESS_STEP, fake.node[node_Brightness]);
+	EXPECT_TRUE(g_status.auto_override);
+
+	// held : clamps at the register limit
+	Press(KEY_BRIGHTNESS_UP, 8);
+	EXPECT_EQ(BRIGHTNESS_LIMIT, fake.node[node_Brightness]);
+	EXPECT_EQ(BRIGHTNESS_LIMIT, g_status.manual_brightness);
+
+	Press(KEY_BRIGHTNESS_DOWN, 0);
+	EXPECT_EQ(BRIGHTNESS_LIMIT - BRIGHTNESS_STEP, fake.node[node_Brightness]);
+
+	// held : stops above a dark panel
+	Press(KEY_BRIGHTNESS_DOWN, 20);
+	EXPECT_EQ(BRIGHTNESS_KEY_MIN, fake.node[node_Brightness]);
+}
+
+TEST_F(ArmonCoreTest, BrightnessDefaultIsOnTheKeyGrid)
+{
+	set_brightness(BRIGHTNESS_DEFAULT);
+	Press(KEY_BRIGHTNESS_DOWN, 0);
+	EXPECT_EQ(BRIGHTNESS_DEFAULT - BRIGHTNESS_STEP, fake.node[node_Brightness]);
+	Press(KEY_BRIGHTNESS_UP, 0);
+	EXPECT_EQ(BRIGHTNESS_DEFAULT, fake.node[node_Brightness]);
+	EXPECT_EQ(0, BRIGHTNESS_DEFAULT % BRIGHTNESS_STEP);
+}
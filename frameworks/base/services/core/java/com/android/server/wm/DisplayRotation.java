@@ -49,8 +49,11 @@ import android.content.pm.PackageManager;
 import android.content.res.Resources;
 import android.database.ContentObserver;
 import android.hardware.power.Boost;
+import android.net.LocalSocket;
+import android.net.LocalSocketAddress;
 import android.net.Uri;
 import android.os.Handler;
+import android.os.MessageQueue;
 import android.os.RemoteException;
 import android.os.SystemProperties;
 import android.os.UserHandle;
@@ -65,6 +68,7 @@ import android.window.WindowContainerTransaction;
 
 import com.android.internal.R;
 import com.android.internal.annotations.VisibleForTesting;
+import com.android.internal.os.BackgroundThread;
 import com.android.internal.protolog.common.ProtoLog;
 import com.android.internal.util.function.pooled.PooledLambda;
 import com.android.server.LocalServices;
@@ -72,6 +76,7 @@ import com.android.server.UiThread;
 import com.android.server.policy.WindowManagerPolicy;
 import com.android.server.statusbar.StatusBarManagerInternal;
 
+import java.io.IOException;
 import java.io.PrintWriter;
 import java.lang.annotation.Retention;
 import java.lang.annotation.RetentionPolicy;
@@ -139,6 +144,33 @@ public class DisplayRotation {
 
     private boolean mAllowSeamlessRotationDespiteNavBarMoving;
 
+    // [feature development] mspark, 26.10.17, sy060 hardware flip
+    // The panel flips its scan direction itself (armon rotate field : 1 horizontal, 2 vertical,
+    // 3 both). Both is a 180 degree rotation, so with persist.prazen.panel.hwflip a 180 degree
+    // rotation is left to the panel and SurfaceFlinger scans out unrotated buffers.
+    // persist.prazen.panel.flip is the flip of the mount / optics, xor-ed with the rotation's.
+    private static final String PROP_PANEL_HWFLIP = "persist.prazen.panel.hwflip";
+    private static final String PROP_PANEL_FLIP = "persist.prazen.panel.flip";
+    private static final String ARMON_SOCKET = "armon";
+    private static final byte ARMON_CMD_SET = 2;            // armon_ctl.h
+    private static final byte ARMON_FIELD_ROTATE = 3;
+    private static final int PANEL_FLIP_BOTH = 3;
+    // [bug fix] mspark, 26.10.17, the flip is cached once armon acknowledged it, and sent again
+    // after a failure or a new armon connection (armon restores rotate from its state file)
+    private static final byte ARMON_CMD_SUBSCRIBE = 3;      // armon_ctl.h
+    private static final int ARMON_CMD_REPLY = 0x80;
+    private static final int ARMON_CMD_EVENT = 0x81;
+    private static final int ARMON_MSG_MAX = 4 + 5 * 4;     // ARMON_MSG_MAX
+    private static final int ARMON_EVENTS = MessageQueue.OnFileDescriptorEventListener.EVENT_INPUT
+            | MessageQueue.OnFileDescriptorEventListener.EVENT_ERROR;
+    private static final long PANEL_FLIP_RETRY_MS = 1000;
+    private int mPanelFlipWanted = -1;      // WM lock
+    // BackgroundThread only
+    private LocalSocket mArmon;
+    private int mArmonFlipWanted = -1;
+    private int mPanelFlip = -1;            // what armon holds, -1 : not known
+    private final Runnable mPanelFlipRetry = this::syncPanelFlip;
+
     private int mDeferredRotationPauseCount;
 
     /**
@@ -283,6 +315,132 @@ public class DisplayRotation {
         return -1;
     }
 
+    // [feature development] mspark, 26.10.17, sy060 hardware flip
+    private int applyPanelFlip(int rotation) {
+        if (!isDefaultDisplay || SystemProperties.getInt(PROP_PANEL_HWFLIP, 0) != 1) {
+            return rotation;
+        }
+
+        int flip = SystemProperties.getInt(PROP_PANEL_FLIP, 0) & PANEL_FLIP_BOTH;
+        if (rotation == Surface.ROTATION_180) {
+            flip ^= PANEL_FLIP_BOTH;
+            rotation = Surface.ROTATION_0;
+        }
+        if (flip != mPanelFlipWanted) {
+            mPanelFlipWanted = flip;
+            final int value = flip;
+            // armon owns the panel nodes, never wait for it under the WM lock
+            BackgroundThread.getHandler().post(() -> {
+                mArmonFlipWanted = value;
+                syncPanelFlip();
+            });
+        }
+        return rotation;
+    }
+
+    // [bug fix] mspark, 26.10.17, one armon connection subscribed to the rotate field, on BackgroundThread.
+    // mPanelFlip only follows what armon reports (reply or event). A refused connect, a rejected write
+    // or a lost connection is retried, and a new connection sends the flip again.
+    private void syncPanelFlip() {
+        final Handler handler = BackgroundThread.getHandler();
+        handler.removeCallbacks(mPanelFlipRetry);
+        if (mArmonFlipWanted < 0) {
+            return;
+        }
+
+        if (mArmon == null) {
+            final LocalSocket sock = new LocalSocket(LocalSocket.SOCKET_SEQPACKET);
+            try {
+                sock.connect(new LocalSocketAddress(ARMON_SOCKET,
+                        LocalSocketAddress.Namespace.RESERVED));
+            } catch (IOException e) {
+                Slog.w(TAG, "panel flip " + mArmonFlipWanted + " : " + e.getMessage());
+                try {
+                    sock.close();
+                } catch (IOException ignored) {
+                    // ignore
+                }
+                handler.postDelayed(mPanelFlipRetry, PANEL_FLIP_RETRY_MS);
+                return;
+            }
+            mArmon = sock;
+            handler.getLooper().getQueue().addOnFileDescriptorEventListener(
+                    sock.getFileDescriptor(), ARMON_EVENTS, (fd, events) -> onArmonEvent(events));
+            // the reply carries the rotate armon holds, the flip follows if it differs
+            sendArmon(ARMON_CMD_SUBSCRIBE, 0);
+            return;
+        }
+
+        if (mArmonFlipWanted != mPanelFlip) {
+            sendArmon(ARMON_CMD_SET, mArmonFlipWanted);
+        }
+    }
+
+    private void sendArmon(byte cmd, int value) {
+        // armon_msg { cmd, count, status, seq } + armon_field { id, reserved, int16 value }
+        final byte[] msg = { cmd, 1, 0, 0, ARMON_FIELD_ROTATE, 0, (byte) value, (byte) (value >> 8) };
+        try {
+            mArmon.getOutputStream().write(msg);
+        } catch (IOException e) {
+            Slog.w(TAG, "panel flip " + mArmonFlipWanted + " : " + e.getMessage());
+            closeArmon();
+            BackgroundThread.getHandler().postDelayed(mPanelFlipRetry, PANEL_FLIP_RETRY_MS);
+        }
+    }
+
+    private int onArmonEvent(int events) {
+        final byte[] msg = new byte[ARMON_MSG_MAX];
+        int len = -1;
+        if ((events & MessageQueue.OnFileDescriptorEventListener.EVENT_ERROR) == 0) {
+            try {
+                len = mArmon.getInputStream().read(msg);
+            } catch (IOException e) {
+                // lost
+            }
+        }
+        if (len < 4) {
+            // armon went away, it comes back with the rotate of its state file
+            Slog.w(TAG, "armon connection lost");
+            closeArmon();
+            BackgroundThread.getHandler().postDelayed(mPanelFlipRetry, PANEL_FLIP_RETRY_MS);
+            return 0;
+        }
+
+        final int cmd = msg[0] & 0xff;
+        if (cmd == ARMON_CMD_REPLY && msg[2] != 0) {
+            Slog.w(TAG, "panel flip " + mArmonFlipWanted + " rejected by armon, status " + msg[2]);
+            BackgroundThread.getHandler().postDelayed(mPanelFlipRetry, PANEL_FLIP_RETRY_MS);
+            return ARMON_EVENTS;
+        }
+        if (cmd == ARMON_CMD_REPLY || cmd == ARMON_CMD_EVENT) {
+            for (int i = 4; i + 4 <= len; i += 4) {
+                if (msg[i] == ARMON_FIELD_ROTATE) {
+                    mPanelFlip = (msg[i + 2] & 0xff) | (msg[i + 3] << 8);
+                }
+            }
+            // subscribe reply, or another client wrote rotate
+            if (mPanelFlip != mArmonFlipWanted) {
+                syncPanelFlip();
+            }
+        }
+        return mArmon != null ? ARMON_EVENTS : 0;
+    }
+
+    private void closeArmon() {
+        if (mArmon == null) {
+            return;
+        }
+        BackgroundThread.getHandler().getLooper().getQueue()
+                .removeOnFileDescriptorEventListener(mArmon.getFileDescriptor());
+        try {
+            mArmon.close();
+        } catch (IOException e) {
+            // ignore
+        }
+        mArmon = null;
+        mPanelFlip = -1;
+    }
+
     /**
      * Updates the configuration which may have different values depending on current user, e.g.
      * runtime resource overlay.
@@ -475,7 +633,8 @@ public class DisplayRotation {
 
         final int oldRotation = mRotation;
         final int lastOrientation = mLastOrientation;
-        final int rotation = rotationForOrientation(lastOrientation, oldRotation);
+        // [feature modify] mspark, 26.10.17, 180 degree left to the sy060 panel flip
+        final int rotation = applyPanelFlip(rotationForOrientation(lastOrientation, oldRotation));
         ProtoLog.v(WM_DEBUG_ORIENTATION,
                 "Computed rotation=%s (%d) for display id=%d based on lastOrientation=%s (%d) and "
                         + "oldRotation=%s (%d)",
@@ -1588,7 +1747,6 @@ public class DisplayRotation {
                     && !mService.mPowerManager.isPowerSaveMode();
         }
 
-
         @Override
         public void onProposedRotationChanged(int rotation) {
             ProtoLog.v(WM_DEBUG_ORIENTATION, "onProposedRotationChanged, rotation=%d", rotation);
@@ -27,23 +27,28 @@
 #include <linux/syscore_ops.h>
 
 #include "types.h"
+#include "sy060ldm01.h"
 
 #define DEV_NAME			"arg24io"
 #define DRIVER_VERSION		"1.0"
 
 static DEFINE_MUTEX(sysfs_lock); 
 
-#define PATH_PANEL		"/sys/bus/i2c/devices/3-004c/display"
+#define PANEL_RESET_US		10000		// panel_reset release -> first i2c transfer
 
 // gpio port
 typedef struct 
 {
 	int	panel_reset;	// panel reset		
 	int	lt_reset;		// lontium controller reset
+	int	panel_on;		// panel_reset level of a running panel
+	int	lt_on;			// lt_reset level of a running controller
 } AR_IOCFG;
 
 static AR_IOCFG ar_cfg;
 static int g_sleep = 0;
+static int g_panel_users = -1;	// sy060 holding the panel rails, -1 : not probed yet
+static int g_panel_cut = 0;		// panel_reset asserted by ar_panel_put
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 int _atoi(const char *s)
@@ -58,36 +63,46 @@ int _atoi(const char *s)
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void ar_drv_sleep(char *path, int val)
+// panel rails : both eyes share panel_reset, it is only asserted once the last panel let go
+int ar_panel_get(void)
 {
-	char buf[4];
-	mm_segment_t fs;
-	struct file *fp;
+	int ret = 0;
 
-	fs = get_fs();
-	set_fs(KERNEL_DS);
-	
-	fp = filp_open(path, O_RDWR, 0664);
-	if (IS_ERR(fp)) {
-		printk("%s: file open error\n", __FUNCTION__);
-        return;
+	mutex_lock(&sysfs_lock);
+	if (g_panel_users < 0 || !gpio_is_valid(ar_cfg.panel_reset)) {
+		ret = -ENODEV;
+	} else if (g_panel_users++ == 0 && g_panel_cut) {
+		gpio_set_value(ar_cfg.panel_reset, ar_cfg.panel_on);
+		g_panel_cut = 0;
+		usleep_range(PANEL_RESET_US, PANEL_RESET_US + 1000);
 	}
-	
-	if (fp) {
-		loff_t f_pos = 0;
-		int len = sizeof(buf);
-		sprintf(buf, "%d\n", val);
-		if (vfs_write(fp, buf, len, &f_pos) != len) {
-			printk("%s: wrtie error\n", __FUNCTION__);
-		}
-		filp_close(fp, NULL);
-		set_fs(fs);	
+	mutex_unlock(&sysfs_lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ar_panel_get);
+
+void ar_panel_put(void)
+{
+	mutex_lock(&sysfs_lock);
+	if (g_panel_users > 0 && --g_panel_users == 0) {
+		gpio_set_value(ar_cfg.panel_reset, !ar_cfg.panel_on);
+		g_panel_cut = 1;
 	}
+	mutex_unlock(&sysfs_lock);
 }
+EXPORT_SYMBOL_GPL(ar_panel_put);
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// reset released : the panels lost their registers, sy060 reloads them
+static void ar_panel_reset(void)
+{
+#if IS_ENABLED(CONFIG_AR_SY060)
+	sy060_group_set(SY_GROUP_RESET, 1);
+#endif
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-#define AR_IO_RW(_name, gpio) \
+#define AR_IO_RW(_name, gpio, _on) \
 static ssize_t _name##_gpio_show(struct device *dev, \
 			struct device_attribute *attr, \
 			char *buf) \
@@ -105,18 +120,27 @@ static ssize_t _name##_gpio_store(struct device *dev, \
 			struct device_attribute *attr, \
 			const char *buf, size_t count) \
 { \
-	int state; \
+	int state = 0, release; \
+	char *envp[] = { "ARG_IO=" #_name, NULL }; \
 	if (buf == NULL) return count; \
 	mutex_lock(&sysfs_lock); \
 	sscanf(buf, "%d", &state); \
+	state = state ? 1 : 0; \
+	release = (state == (_on)) && (gpio_get_value(gpio) != state); \
 	gpio_set_value(gpio, state); \
 	mutex_unlock(&sysfs_lock); \
+	/* the panel state is lost on reset : sy060 reloads the panel, then armon re-applies its values */ \
+	if (release) { \
+		usleep_range(PANEL_RESET_US, PANEL_RESET_US + 1000); \
+		ar_panel_reset(); \
+	} \
+	kobject_uevent_env(&dev->kobj, KOBJ_CHANGE, envp); \
 	return count; \
 } \
 static DEVICE_ATTR(_name, 0660, _name##_gpio_show, _name##_gpio_store);
 
-AR_IO_RW(panel_reset, ar_cfg.panel_reset);		// panel reset	
-AR_IO_RW(lt_reset, ar_cfg.lt_reset);	// panel reset
+AR_IO_RW(panel_reset, ar_cfg.panel_reset, ar_cfg.panel_on);		// panel reset	
+AR_IO_RW(lt_reset, ar_cfg.lt_reset, ar_cfg.lt_on);	// panel reset
 
 static struct attribute *ar_io_attributes[] = {
 	&dev_attr_panel_reset.attr,	
@@ -162,7 +186,8 @@ static int ar_io_parse_dt(struct platform_device *pdev)
 			dev_err(&pdev->dev, "failed to request GPIO%d : %d\n",gpio, __LINE__);
 			return err;
 		}		
-		gpio_direction_output(gpio, (flags & OF_GPIO_ACTIVE_LOW) ? 0 : 1);
+		ar_cfg.panel_on = (flags & OF_GPIO_ACTIVE_LOW) ? 0 : 1;
+		gpio_direction_output(gpio, ar_cfg.panel_on);
 	}
 	
 	gpio = of_get_named_gpio_flags(np, "lt_reset", 0, &flags);
@@ -173,16 +198,20 @@ static int ar_io_parse_dt(struct platform_device *pdev)
 			dev_err(&pdev->dev, "failed to request GPIO%d : %d\n",gpio, __LINE__);
 			return err;
 		}		
-		gpio_direction_output(gpio, (flags & OF_GPIO_ACTIVE_LOW) ? 0 : 1);
+		ar_cfg.lt_on = (flags & OF_GPIO_ACTIVE_LOW) ? 0 : 1;
+		gpio_direction_output(gpio, ar_cfg.lt_on);
 	}
 
 	return 0;	
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
+// every panel at once, not only the one at 3-004c. panels on a DRM pipeline blank with its commit
 static void arg24_sleep(int val)
 {
-	ar_drv_sleep(PATH_PANEL, val ? 0 : 1);
+#if IS_ENABLED(CONFIG_AR_SY060)
+	sy060_group_set(SY_GROUP_BLANK, val ? 0 : 1);
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -217,6 +246,10 @@ static int ar_io_probe(struct platform_device *pdev)
 
 	ar_io_parse_dt(pdev);
 
+	mutex_lock(&sysfs_lock);
+	g_panel_users = 0;
+	mutex_unlock(&sysfs_lock);
+
 	ret = sysfs_create_group(&pdev->dev.kobj, &ar_io_attribute_group);
 	if (ret) {
 		dev_err(&pdev->dev, "sysfs init failed. error=%d\n", ret);
@@ -0,0 +1,62 @@
+/*
+ *  sy060_trace.h - SeeYA OLED 0.6' panel trace events
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd. 
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sy060
+
+#if !defined(_SY060_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _SY060_TRACE_H_
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+// one regmap access of sy060_xfer : op is XFER_OP, bus 0 when the cache answered it
+TRACE_EVENT(sy060_xfer,
+
+	TP_PROTO(struct device *dev, int op, u16 reg, int len, int bus, int retries, s64 ns, int ret),
+
+	TP_ARGS(dev, op, reg, len, bus, retries, ns, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, op)
+		__field(u16, reg)
+		__field(int, len)
+		__field(int, bus)
+		__field(int, retries)
+		__field(s64, ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->op = op;
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->bus = bus;
+		__entry->retries = retries;
+		__entry->ns = ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s %s reg=0x%04x len=%d%s retries=%d ns=%lld ret=%d",
+		__get_str(dev),
+		__print_symbolic(__entry->op, { 0, "write" }, { 1, "update" }, { 2, "read" }, { 3, "burst" }, { 4, "read_burst" }),
+		__entry->reg, __entry->len, __entry->bus ? "" : " cached",
+		__entry->retries, __entry->ns, __entry->ret)
+);
+
+#endif	//_SY060_TRACE_H_
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sy060_trace
+#include <trace/define_trace.h>
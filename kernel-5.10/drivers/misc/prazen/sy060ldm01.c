@@ -13,21 +13,46 @@
 #include <linux/init.h>
 #include <linux/slab.h>
 #include <linux/i2c.h>
+#include <linux/regmap.h>
 #include <linux/delay.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/ktime.h>
+#include <linux/pm_runtime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
 #include <linux/gpio.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/fb.h>
 
+#include <drm/drm_crtc.h>
+#include <drm/drm_modes.h>
+#include <drm/drm_panel.h>
+#include <video/display_timing.h>
+#include <video/of_display_timing.h>
+#include <video/videomode.h>
+
 #include "types.h"
 #include "sy060ldm01.h"
 
+#define CREATE_TRACE_POINTS
+#include "sy060_trace.h"
+
 #define SY060_DEV_NAME		"sy060"
 #define DRIVER_VERSION		"1.0"
 
-#define MAX_BRIGHTNESS		(0x7A)
+#define MAX_BRIGHTNESS		(SY_MAX_BRIGHTNESS)
+#define BRIGHTNESS_DEFAULT	(64)	// armon BRIGHTNESS_DEFAULT, first boot takes it from the panel
+#define SLEEP_OUT_MS		100		// sleep-out (0x1100) settle time before display-on
+#define SLEEP_IN_MS			100		// sleep-in (0x1000) settle time before the rails drop
+#define AUTOSUSPEND_MS		1000	// display-off -> sleep-in, power/autosuspend_delay_ms
+#define SY_MODE_MAX			4		// display-timings entries
+#define SY_MODE_REGS		16		// seeya,regs / seeya,lp-regs pairs
+#define SY_XFER_RETRY		2		// extra attempts on a NAK / lost arbitration
+#define SY_HIST_BUCKETS		16		// log2 buckets of microseconds
 
 typedef enum
 {
@@ -38,143 +63,429 @@ typedef enum
 	flip_max
 } FLIP_DATA;
 
+typedef enum
+{
+	pm_active,		// display on
+	pm_blank,		// display off, panel awake
+	pm_sleep,		// sleep-in, registers kept
+	pm_off,			// rails dropped or system suspend, signature check on resume
+	pm_max
+} PM_STATE;
+
+typedef enum
+{
+	xfer_write,
+	xfer_update,
+	xfer_read,
+	xfer_burst,
+	xfer_read_burst,
+} XFER_OP;
+
+// one display-timings entry and the registers it differs from the init table in
+typedef struct
+{
+	struct drm_display_mode mode;
+	int nregs;
+	u16 regs[SY_MODE_REGS][2];	// reg, val
+	int lp;						// seeya,low-persistence : lp-regs go with this mode
+} SY060_MODE;
+
+#if IS_ENABLED(CONFIG_AR_IO)
+#define sy060_rail_get()	(ar_panel_get() == 0)
+#define sy060_rail_put()	ar_panel_put()
+#else
+#define sy060_rail_get()	0
+#define sy060_rail_put()	do { } while (0)
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
+// one per panel (DT node), a stereo unit has one per eye
 struct sy060_data {
 	struct i2c_client *client;
+	struct regmap *regmap;
 	struct mutex update_lock;
+	struct mutex display_lock;	// display on/off and its runtime PM reference
+	struct list_head group;		// sy060_group entry
+	int display;		// display on/off
+	int rail;			// holds the arg24io panel rails
+	int rail_off;		// drop the rails in runtime suspend
+	int cold;			// register state may be lost, resume checks the signature
+	int pm_state;		// PM_STATE
+	ktime_t pm_since;
+	ktime_t pm_time[pm_max];
+	ktime_t resume_start;	// runtime resume in progress, until the display work ran
+	int resume_cnt;
+	int resume_fast;	// register signature held, sleep-out only
+	int resume_full;	// signature lost, init table
+	s64 resume_last_us;
+	s64 resume_max_us;
+	spinlock_t hist_lock;
+	u32 lat_hist[SY_HIST_BUCKETS];		// bus transfers per duration
+	u32 retry_hist[SY_XFER_RETRY + 1];	// bus transfers per retry count
+	u32 xfer_errors;
+	struct dentry *debugfs;
+	int xfer_cnt;		// i2c transfers of the last panel init
+	int xfer_bytes;		// bytes on the bus, addresses included
 	struct delayed_work SY060_work;
+	struct drm_panel panel;
+	int drm;			// driven by the DRM pipeline, FB blank ignored
+	int prepared;		// runtime PM reference of drm prepare
+	struct drm_connector *connector;	// of the last get_modes
+	SY060_MODE modes[SY_MODE_MAX];
+	int nmodes;
+	int native;			// preferred mode
+	int nlp;
+	u16 lp_regs[SY_MODE_REGS][2];	// low persistence (emission duty), over any mode
+	int mode_next;		// wanted mode / low persistence
+	int lp_next;
+	int lp_user;		// low_persistence (sysfs, group), or-ed with the mode's
+	int mode_cur;		// what the panel holds, -1 : init table
+	int lp_cur;
+	u8 flip_hw;			// flip the panel went down with, the cache may hold a newer one
 };
-struct sy060_data *g_data;
 
-typedef struct
-{
-	int	display;		// display on/off
-	int	brightness;		// brightness
-	int	sleep;			// sleep flag
-}SY060_CONFIG;
-static SY060_CONFIG s06_cfg;
+// every probed panel, group control applies a value to all of them
+static LIST_HEAD(sy060_group);
+static DEFINE_MUTEX(sy060_group_lock);
+static s64 sy060_group_skew_ns;		// first -> last panel of the last group write
+static struct dentry *sy060_debugfs;	// debugfs sy060/, one directory per panel
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-static int sy060_write(struct i2c_client *client, u16 reg, u8 val)
+// state registers are cached, everything else (commands, init table) goes straight to the panel
+static bool sy060_volatile_reg(struct device *dev, unsigned int reg)
 {
-	int err, cnt;
-	u8 data[3];
-	struct i2c_msg msg;
-
-	data[0] = (u8)((reg >> 8) & 0xFF);
-	data[1] = (u8)(reg & 0xFF);
-	data[2] = val;
+	switch (reg) {
+	case SY_FLIP_REG:
+	case SY_BRIGHTNESS_REG:
+	case SY_BRIGHTNESS2_REG:
+		return false;
+	}
+	return true;
+}
 
-	msg.addr = client->addr;
-	msg.flags = client->flags;
-	msg.buf = data;
-	msg.len = val;
+// values left by sy060_init_client : regcache_sync only writes what differs from them
+static const struct reg_default sy060_reg_defaults[] = {
+	{ SY_FLIP_REG,			0x00 },
+	{ SY_BRIGHTNESS_REG,	0xFF },
+	{ SY_BRIGHTNESS2_REG,	0x00 },
+};
 
-	cnt = 3;
-	err = -EAGAIN;
+static const struct regmap_config sy060_regmap_config = {
+	.reg_bits = 16,
+	.val_bits = 8,
+	.max_register = 0xFFFF,
+	.volatile_reg = sy060_volatile_reg,
+	.reg_defaults = sy060_reg_defaults,
+	.num_reg_defaults = ARRAY_SIZE(sy060_reg_defaults),
+	.cache_type = REGCACHE_RBTREE,
+};
 
-	while ((cnt-- > 0) && (err < 0)) {
-		err = i2c_transfer(client->adapter, &msg, 1);
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// every register access : retried on a NAK / lost arbitration, traced (sy060_xfer) and, when it reached
+// the bus, counted in the debugfs histogram. -EBUSY (cache only) is not retried
+static int sy060_xfer(struct sy060_data *data, int op, u16 reg, const u8 *buf, int len, void *val)
+{
+	ktime_t start = ktime_get();
+	bool change = true;
+	int ret, retries = 0, bus, b;
+	unsigned long flags;
+	s64 ns;
 
-		if (err >= 0) {
-			err = 0;
-			goto out;
-		} else {
-			printk(KERN_ERR"\n %s write (reg:0x%04x) failed, try to write again!\n", SY060_DEV_NAME, reg);
-			udelay(10);
+	for (;;) {
+		switch (op) {
+			case xfer_write:	ret = regmap_write(data->regmap, reg, buf[0]);							break;
+			case xfer_update:	ret = regmap_update_bits_check(data->regmap, reg, 0xFF, buf[0], &change);	break;
+			case xfer_read:		ret = regmap_read(data->regmap, reg, val);								break;
+			case xfer_read_burst:	ret = regmap_bulk_read(data->regmap, reg, val, len);				break;
+			default:			ret = regmap_bulk_write(data->regmap, reg, buf, len);					break;
 		}
+		if ((ret != -ENXIO && ret != -EAGAIN && ret != -EREMOTEIO) || retries >= SY_XFER_RETRY)
+			break;
+		retries++;
 	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 
-out:
+	// cached registers : reads and unchanged updates never leave the regmap
+	bus = (op == xfer_read) ? sy060_volatile_reg(NULL, reg) : (op != xfer_update || change);
+	trace_sy060_xfer(&data->client->dev, op, reg, len, bus, retries, ns, ret);
+
+	if (bus) {
+		for (b = 0; b < SY_HIST_BUCKETS - 1 && (ns / 1000) >= (1LL << b); b++)
+			;
+		spin_lock_irqsave(&data->hist_lock, flags);
+		data->lat_hist[b]++;
+		data->retry_hist[retries]++;
+		if (ret < 0)
+			data->xfer_errors++;
+		spin_unlock_irqrestore(&data->hist_lock, flags);
+	}
+	return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static int sy060_write(struct i2c_client *client, u16 reg, u8 val)
+{
+	struct sy060_data *data = i2c_get_clientdata(client);
+	int err;
+
+	err = sy060_xfer(data, xfer_write, reg, &val, 1, NULL);
+	if (err < 0)
+		dev_err(&client->dev, "write (reg:0x%04x) failed %d\n", reg, err);
+	return err;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// cached register : no bus traffic when the panel already holds val
+static int sy060_update(struct i2c_client *client, u16 reg, u8 val)
+{
+	struct sy060_data *data = i2c_get_clientdata(client);
+	int err;
+
+	err = sy060_xfer(data, xfer_update, reg, &val, 1, NULL);
+	if (err < 0)
+		dev_err(&client->dev, "update (reg:0x%04x) failed %d\n", reg, err);
 	return err;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 static u8 sy060_read(struct i2c_client *client, u16 reg)
 {
-	int err, cnt;
-	u8 val = 0;
-	u8 data[3];
-	struct i2c_msg msg[2];
-
-	data[0] = (u8)((reg >> 8) & 0xFF);
-	data[1] = (u8)(reg & 0xFF);
-
-	msg[0].addr = client->addr;
-	msg[0].flags = client->flags;
-	msg[0].buf = &data[0];
-	msg[0].len = 2;
-
-	msg[1].addr = client->addr;
-	msg[1].flags = client->flags | I2C_M_RD;
-	msg[1].buf = &data[2];
-	msg[1].len = 1;
-
-	cnt = 3;
-	err = -EAGAIN;
-	while ((cnt-- > 0) && (err < 0)) {
-		err = i2c_transfer(client->adapter, msg, 2);
-		if (err >= 0) {
-			val = data[2];
-			break;
-		} else {
-			printk("\n %s read (reg:0x%04x) failed, try to read again! \n", SY060_DEV_NAME, reg);
-			udelay(10);
+	struct sy060_data *data = i2c_get_clientdata(client);
+	unsigned int val = 0;
+
+	if (sy060_xfer(data, xfer_read, reg, NULL, 1, &val) < 0)
+		dev_err(&client->dev, "read (reg:0x%04x) failed\n", reg);
+	return (u8)val;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// panel init, contiguous registers as one auto-increment burst each
+static const struct i2c_set_data_type sy060_init_table[] = {
+	{ 0xFF01, 1, { 0x81 } },
+	{ 0xF406, 1, { 0x55 } },
+	{ 0x5300, 1, { 0x24 } },
+	{ 0x5100, 2, { 0xFF, 0x00 } },
+	{ 0x0300, 1, { 0x00 } },
+	{ 0x8000, 6, { 0x01, 0xE0, 0xE0, 0x0E, 0x00, 0x31 } },
+	{ 0x8100, 21, { 0x04, 0x82, 0x00, 0x10, 0x00, 0x10, 0x00,
+					0x04, 0x82, 0x00, 0x10, 0x00, 0x10, 0x00,
+					0x04, 0x82, 0x00, 0x10, 0x00, 0x10, 0x00 } },
+	{ 0x6C00, 1, { 0x00 } },
+	{ 0x3500, 1, { 0x00 } },
+	{ 0x2600, 1, { 0x20 } },
+	{ 0xFF00, 2, { 0x5A, 0x80 } },
+	{ 0xF249, 1, { 0x01 } },
+	{ 0xFF00, 2, { 0x5A, 0x81 } },
+	{ 0xF61D, 1, { 0x30 } },
+	{ 0xF429, 1, { 0x04 } },
+	{ 0xF000, 2, { 0xAA, 0x10 } },
+	{ 0xB102, 1, { 0x09 } },
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int sy060_write_table(struct i2c_client *client, const struct i2c_set_data_type *table, int cnt)
+{
+	struct sy060_data *data = i2c_get_clientdata(client);
+	int i, err;
+
+	for (i = 0; i < cnt; i++) {
+		err = sy060_xfer(data, xfer_burst, table[i].reg, table[i].data, table[i].data_len, NULL);
+		if (err < 0) {
+			dev_err(&client->dev, "burst (reg:0x%04x, %d) failed %d\n",
+				table[i].reg, table[i].data_len, err);
+			return err;
 		}
+		data->xfer_cnt++;
+		data->xfer_bytes += 2 + table[i].data_len;	// 16-bit address + run
 	}
+	return 0;
+}
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// modes : display-timings of the sy060 node (native-mode is the preferred one). Every timing lists the
+// registers it changes from the init table in seeya,regs = /bits/ 16 <reg val ...>, all timings the same
+// registers. seeya,lp-regs on the sy060 node : low persistence, applied over any mode, by low_persistence
+// or by a timing marked seeya,low-persistence (a DRM mode of its own, its timings must differ)
+static int sy060_init_value(u16 reg)
+{
+	int i, val = -1;
+
+	// last write wins, 0xFF00 (page select) is written more than once
+	for (i = 0; i < ARRAY_SIZE(sy060_init_table); i++)
+		if (reg >= sy060_init_table[i].reg && reg < sy060_init_table[i].reg + sy060_init_table[i].data_len)
+			val = sy060_init_table[i].data[reg - sy060_init_table[i].reg];
 	return val;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static int get_nits(u8 val) 
-{
-	int nits = 0;
-	if (1 == val) {
-		nits = 300;	// 0x01
-	} else if (2 <= val && val <= 9) {
-		nits = ((200 * 10) / 9 * (val - 1) / 10) + 300;
-	} else if (10 == val) {
-		nits = 500;
-	} else if (11 <= val && val <= 19) {
-		nits = (200 / 10 * (val - 10)) + 500;
-	} else if (20 == val) {
-		nits = 700;		
-	} else if (21 <= val && val <= 29) {
-		nits = (200 / 10 * (val - 20)) + 500;	
-	} else if (30 == val) {
-		nits = 900;	
-	} else if (31 <= val && val <= 103) {
-		nits = ((1700 * 100) / 74 * (val - 30) / 100) + 900;	
-	} else if (104 == val) {
-		nits = 2600;			
-	} else if (105 <= val && val <= 179) {
-		nits = ((1700 * 100) / 76 * (val - 104) / 100) + 2600;	
+static int sy060_regs_find(u16 (*regs)[2], int cnt, u16 reg)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		if (regs[i][0] == reg)
+			return regs[i][1];
+	return -1;
+}
+
+// register value of a mode / low persistence state, -1 : unknown
+static int sy060_mode_value(struct sy060_data *data, int mode, int lp, u16 reg)
+{
+	int val = -1;
+
+	if (lp)
+		val = sy060_regs_find(data->lp_regs, data->nlp, reg);
+	if (val < 0 && mode >= 0)
+		val = sy060_regs_find(data->modes[mode].regs, data->modes[mode].nregs, reg);
+	if (val < 0)
+		val = sy060_init_value(reg);
+	return val;
+}
+
+// write a register only when the wanted state holds another value than the current one
+static int sy060_mode_diff(struct sy060_data *data, u16 (*regs)[2], int cnt, int done)
+{
+	int i, old, val;
+
+	for (i = 0; i < cnt; i++) {
+		old = sy060_mode_value(data, data->mode_cur, data->lp_cur, regs[i][0]);
+		val = sy060_mode_value(data, data->mode_next, data->lp_next, regs[i][0]);
+		if (val < 0 || old == val)
+			continue;
+		sy060_write(data->client, regs[i][0], val);
+		done++;
+	}
+	return done;
+}
+
+// update_lock held, panel awake
+static int sy060_mode_apply(struct sy060_data *data)
+{
+	int cnt = 0;
+
+	if (data->mode_next == data->mode_cur && data->lp_next == data->lp_cur)
+		return 0;
+
+	if (data->mode_cur >= 0)
+		cnt = sy060_mode_diff(data, data->modes[data->mode_cur].regs, data->modes[data->mode_cur].nregs, cnt);
+	if (data->mode_next >= 0 && data->mode_next != data->mode_cur)
+		cnt = sy060_mode_diff(data, data->modes[data->mode_next].regs, data->modes[data->mode_next].nregs, cnt);
+	cnt = sy060_mode_diff(data, data->lp_regs, data->nlp, cnt);
+
+	data->mode_cur = data->mode_next;
+	data->lp_cur = data->lp_next;
+	data->xfer_cnt += cnt;
+	data->xfer_bytes += cnt * 3;
+	return cnt;
+}
+
+static void sy060_parse_modes(struct sy060_data *data)
+{
+	struct device *dev = &data->client->dev;
+	struct device_node *timings_np, *entry;
+	struct display_timings *disp;
+	struct videomode vm;
+	int i = 0, n;
+
+	data->native = -1;
+	data->mode_cur = -1;
+	data->mode_next = -1;
+
+	n = of_property_read_variable_u16_array(dev->of_node, "seeya,lp-regs", &data->lp_regs[0][0],
+			2, SY_MODE_REGS * 2);
+	data->nlp = (n > 0) ? n / 2 : 0;
+
+	timings_np = of_get_child_by_name(dev->of_node, "display-timings");
+	if (!timings_np)
+		return;
+	disp = of_get_display_timings(dev->of_node);
+	if (!disp)
+		goto out;
+
+	// same order as of_get_display_timings
+	for_each_child_of_node(timings_np, entry) {
+		SY060_MODE *m;
+
+		if (i >= disp->num_timings || i >= SY_MODE_MAX) {
+			of_node_put(entry);
+			break;
+		}
+		m = &data->modes[i];
+		videomode_from_timings(disp, &vm, i);
+		drm_display_mode_from_videomode(&vm, &m->mode);
+		drm_mode_set_name(&m->mode);
+		m->mode.type = DRM_MODE_TYPE_DRIVER;
+		n = of_property_read_variable_u16_array(entry, "seeya,regs", &m->regs[0][0], 2, SY_MODE_REGS * 2);
+		m->nregs = (n > 0) ? n / 2 : 0;
+		m->lp = of_property_read_bool(entry, "seeya,low-persistence") && data->nlp;
+		dev_info(dev, "mode %s@%d, %d registers%s\n", m->mode.name, drm_mode_vrefresh(&m->mode), m->nregs,
+				m->lp ? ", low persistence" : "");
+		i++;
 	}
-	return nits;
+	data->nmodes = i;
+	if (data->nmodes) {
+		data->native = (disp->native_mode < data->nmodes) ? disp->native_mode : 0;
+		data->modes[data->native].mode.type |= DRM_MODE_TYPE_PREFERRED;
+		data->mode_next = data->native;
+		data->lp_next = data->modes[data->native].lp;
+	}
+	display_timings_release(disp);
+out:
+	of_node_put(timings_np);
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// panel luminance (nits) per brightness register value, piecewise curve from the SY060 datasheet
+#define SY_NITS(v) \
+	((v) == 1 ? 300 : \
+	 (v) <= 9 ? ((200 * 10) / 9 * ((v) - 1) / 10) + 300 : \
+	 (v) == 10 ? 500 : \
+	 (v) <= 19 ? (200 / 10 * ((v) - 10)) + 500 : \
+	 (v) == 20 ? 700 : \
+	 (v) <= 29 ? (200 / 10 * ((v) - 20)) + 500 : \
+	 (v) == 30 ? 900 : \
+	 (v) <= 103 ? ((1700 * 100) / 74 * ((v) - 30) / 100) + 900 : \
+	 (v) == 104 ? 2600 : \
+	 (v) <= 179 ? ((1700 * 100) / 76 * ((v) - 104) / 100) + 2600 : 0)
+
+#define SY_NITS2(v)		SY_NITS(v), SY_NITS((v) + 1)
+#define SY_NITS8(v)		SY_NITS2(v), SY_NITS2((v) + 2), SY_NITS2((v) + 4), SY_NITS2((v) + 6)
+#define SY_NITS32(v)	SY_NITS8(v), SY_NITS8((v) + 8), SY_NITS8((v) + 16), SY_NITS8((v) + 24)
+
+// brightness level is the 0x5100 register value, level 0 : panel dark
+const u16 sy060_nits[MAX_BRIGHTNESS + 1] = {
+	0, SY_NITS(1), SY_NITS2(2), SY_NITS2(4), SY_NITS2(6),
+	SY_NITS8(8), SY_NITS8(16), SY_NITS8(24), SY_NITS32(32), SY_NITS32(64),
+	SY_NITS8(96), SY_NITS8(104), SY_NITS8(112), SY_NITS2(120), SY_NITS(122),
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 static int sy060_brightness(struct i2c_client *client, u8 val)
 {
 	if (val > MAX_BRIGHTNESS) {
-		printk("[Panel] set brightness error %d\n", val);
+		dev_dbg(&client->dev, "set brightness error %d\n", val);
 		return 0;
 	}
-	printk("[Panel] set brightness %d = nits %d\n", val, get_nits(val));
+	dev_dbg(&client->dev, "set brightness %d = nits %d\n", val, sy060_nits[val]);
+	sy060_update(client, SY_BRIGHTNESS_REG, val);
 	return 1;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int sy060_get_brightness(struct i2c_client *client)
+{
+	return sy060_read(client, SY_BRIGHTNESS_REG);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 static int sy060_rotate(struct i2c_client *client, u8 val)
 {
 	u8 flip = 0x00;
 		
-	if (val > flip_max) {
-		printk("[Panel] set rotate error %d\n", val);
+	if (val >= flip_max) {
+		dev_dbg(&client->dev, "set rotate error %d\n", val);
 		return 0;
 	}
-	printk("[Panel] set rotate = %d\n", val);
+	dev_dbg(&client->dev, "set rotate = %d\n", val);
 
 	switch (val) {
 		case flip_horizontal:	flip = 0x02;	break;
@@ -182,28 +493,337 @@ static int sy060_rotate(struct i2c_client *client, u8 val)
 		case flip_all:			flip = 0x03;	break;
         default:    break;
 	}
-	sy060_write(client, SY_FLIP_REG, flip);
+	sy060_update(client, SY_FLIP_REG, flip);
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int sy060_get_rotate(struct i2c_client *client)
+{
+	switch (sy060_read(client, SY_FLIP_REG) & 0x03) {
+		case 0x02:	return flip_horizontal;
+		case 0x01:	return flip_vertical;
+		case 0x03:	return flip_all;
+	}
+	return flip_normal;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// time per PM_STATE, boottime so that system suspend counts as off. update_lock held
+static void sy060_pm_state(struct sy060_data *data, int state)
+{
+	ktime_t now = ktime_get_boottime();
+
+	data->pm_time[data->pm_state] = ktime_add(data->pm_time[data->pm_state], ktime_sub(now, data->pm_since));
+	data->pm_since = now;
+	data->pm_state = state;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// second half of the panel init or of a runtime resume, SLEEP_OUT_MS after the sleep-out
+static void sy060_display_work(struct work_struct *work)
+{
+	struct sy060_data *data = container_of(to_delayed_work(work), struct sy060_data, SY060_work);
+	struct i2c_client *client = data->client;
+	s64 us;
+
+	mutex_lock(&data->update_lock);
+
+	sy060_write(client, (data->display ? SY_DISP_ON_REG : SY_DISP_OFF_REG), 0x00);
+	data->xfer_cnt += 1;
+	data->xfer_bytes += 3;
+
+	// brightness / flip changed while the panel was down, nothing when the cache is clean
+	regcache_sync(data->regmap);
+
+	sy060_pm_state(data, data->display ? pm_active : pm_blank);
+	if (data->resume_start) {
+		us = ktime_us_delta(ktime_get(), data->resume_start);
+		data->resume_start = 0;
+		data->resume_cnt++;
+		data->resume_last_us = us;
+		if (us > data->resume_max_us)
+			data->resume_max_us = us;
+	}
+
+	mutex_unlock(&data->update_lock);
+
+	dev_dbg(&client->dev, "init : %d transfers, %d bytes\n", data->xfer_cnt, data->xfer_bytes);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int sy060_init_client(struct i2c_client *client)
+{
+	struct sy060_data *data = i2c_get_clientdata(client);
+	int ret;
+
+	data->xfer_cnt = 0;
+	data->xfer_bytes = 0;
+
+	ret = sy060_write(client, 0xFF00, 0x5A);
+	if (ret < 0) {
+		goto exit;
+	}
+	dev_dbg(&client->dev, "check i2c = %02X\n", sy060_read(client, 0xFF00));
+	data->xfer_cnt += 1;
+	data->xfer_bytes += 3;
+
+	ret = sy060_write_table(client, sy060_init_table, ARRAY_SIZE(sy060_init_table));
+	if (ret < 0)
+		goto exit;
+
+	// the panel is back to the init table, then the wanted mode on top
+	data->mode_cur = -1;
+	data->lp_cur = 0;
+	sy060_mode_apply(data);
+
+	sy060_write(client, SY_SLEEP_OUT_REG, 0x00);
+	data->xfer_cnt += 1;
+	data->xfer_bytes += 3;
+
+	// display-on once the sleep-out has settled, nobody waits for it
+	schedule_delayed_work(&data->SY060_work, msecs_to_jiffies(SLEEP_OUT_MS));
 	return 1;
+
+exit:
+	dev_err(&client->dev, "%s: error ret = %d\n", __func__, ret);
+	return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// registers read back on resume : page select, the 0x8000 block and flip. A panel that kept them kept the
+// init table and the current mode, one that lost power NAKs or reads back its reset values
+static const struct {
+	u16 reg;
+	u8 len;
+} sy060_sig[] = {
+	{ 0xFF00,		2 },
+	{ 0x8000,		6 },
+	{ SY_FLIP_REG,	1 },
+};
+
+// cache bypassed
+static bool sy060_signature_ok(struct sy060_data *data)
+{
+	u8 buf[8];
+	int i, j, val;
+
+	for (i = 0; i < ARRAY_SIZE(sy060_sig); i++) {
+		if (sy060_xfer(data, xfer_read_burst, sy060_sig[i].reg, NULL, sy060_sig[i].len, buf) < 0)
+			return false;
+		data->xfer_cnt++;
+		data->xfer_bytes += 2 + sy060_sig[i].len;
+
+		for (j = 0; j < sy060_sig[i].len; j++) {
+			if (sy060_sig[i].reg == SY_FLIP_REG)
+				val = data->flip_hw;
+			else
+				val = sy060_mode_value(data, data->mode_cur, data->lp_cur, sy060_sig[i].reg + j);
+			if (val >= 0 && buf[j] != val) {
+				dev_dbg(&data->client->dev, "signature 0x%04x : %02x, expected %02x\n",
+					sy060_sig[i].reg + j, buf[j], val);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// resume after the register state may have been lost : sleep-out only when the signature still matches,
+// the init table otherwise. update_lock held
+static void sy060_restore(struct sy060_data *data)
+{
+	u8 flip = sy060_read(data->client, SY_FLIP_REG);	// cache, before the bypass
+
+	// the init table is the panel's reset state, not something regcache_sync may replay
+	regcache_cache_bypass(data->regmap, true);
+	data->xfer_cnt = 0;
+	data->xfer_bytes = 0;
+
+	if (sy060_signature_ok(data)) {
+		data->resume_fast++;
+		// rotated while down : regcache_sync skips a flip back to its default after a mark dirty
+		if (flip != data->flip_hw) {
+			sy060_write(data->client, SY_FLIP_REG, flip);
+			data->xfer_cnt += 1;
+			data->xfer_bytes += 3;
+		}
+		sy060_mode_apply(data);
+		sy060_write(data->client, SY_SLEEP_OUT_REG, 0x00);
+		data->xfer_cnt += 1;
+		data->xfer_bytes += 3;
+		schedule_delayed_work(&data->SY060_work, msecs_to_jiffies(SLEEP_OUT_MS));
+	} else {
+		data->resume_full++;
+		sy060_init_client(data->client);
+	}
+	regcache_cache_bypass(data->regmap, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// display on holds a runtime PM reference, display off lets the panel autosuspend into sleep-in.
+// display_lock held
+static void sy060_display_locked(struct sy060_data *data, int on)
+{
+	struct device *dev = &data->client->dev;
+	int ret;
+
+	on = on ? 1 : 0;
+	if (on == data->display)
+		return;
+
+	if (on) {
+		// panel did not wake : stays off, the next display on tries again
+		ret = pm_runtime_get_sync(dev);
+		if (ret < 0) {
+			dev_err(dev, "display on : resume failed %d\n", ret);
+			pm_runtime_put_noidle(dev);
+			return;
+		}
+		data->display = 1;
+		mutex_lock(&data->update_lock);
+		// a panel woken from sleep-in gets its display-on from the resume work
+		if (!delayed_work_pending(&data->SY060_work)) {
+			sy060_write(data->client, SY_DISP_ON_REG, 0x00);
+			sy060_pm_state(data, pm_active);
+		}
+		mutex_unlock(&data->update_lock);
+	} else {
+		// not before the pending display-on of the init
+		flush_delayed_work(&data->SY060_work);
+		mutex_lock(&data->update_lock);
+		sy060_write(data->client, SY_DISP_OFF_REG, 0x00);
+		data->display = 0;
+		sy060_pm_state(data, pm_blank);
+		mutex_unlock(&data->update_lock);
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+}
+
+static void sy060_display(struct sy060_data *data, int on)
+{
+	mutex_lock(&data->display_lock);
+	sy060_display_locked(data, on);
+	mutex_unlock(&data->display_lock);
+}
+
+// FB blank : only panels the DRM pipeline does not drive
+static void sy060_blank(struct sy060_data *data, int on)
+{
+	mutex_lock(&data->display_lock);
+	if (!data->drm)
+		sy060_display_locked(data, on);
+	mutex_unlock(&data->display_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// update_lock held
+static void sy060_lp_update(struct sy060_data *data)
+{
+	data->lp_next = data->lp_user || (data->mode_next >= 0 && data->modes[data->mode_next].lp);
 }
 
+// reduced emission duty, right away when the panel is awake, else with the next resume
+static void sy060_low_persistence(struct sy060_data *data, int on)
+{
+	struct device *dev = &data->client->dev;
+	int ret;
+
+	mutex_lock(&data->update_lock);
+	data->lp_user = on ? 1 : 0;
+	sy060_lp_update(data);
+	mutex_unlock(&data->update_lock);
+
+	ret = pm_runtime_get_if_in_use(dev);
+	if (ret == 0)
+		return;
+	mutex_lock(&data->update_lock);
+	sy060_mode_apply(data);
+	mutex_unlock(&data->update_lock);
+	if (ret > 0)
+		pm_runtime_put_autosuspend(dev);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// arg24io released panel_reset / lt_reset : the panel holds its reset values whatever the cache says.
+// an awake panel gets the init table and, from the display work, display and the cached brightness / flip
+// back before armon re-applies them. a suspended one is cold, its next resume does the same
+static void sy060_reset(struct sy060_data *data)
+{
+	struct device *dev = &data->client->dev;
+
+	mutex_lock(&data->display_lock);
+	cancel_delayed_work_sync(&data->SY060_work);
+
+	mutex_lock(&data->update_lock);
+	regcache_mark_dirty(data->regmap);
+	data->mode_cur = -1;
+	data->lp_cur = 0;
+	data->flip_hw = 0x00;
+	data->cold = 1;
+	mutex_unlock(&data->update_lock);
+
+	if (pm_runtime_get_if_active(dev, true) > 0) {
+		mutex_lock(&data->update_lock);
+		sy060_restore(data);
+		data->cold = 0;
+		mutex_unlock(&data->update_lock);
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+	mutex_unlock(&data->display_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void sy060_set(struct sy060_data *data, int id, int val)
+{
+	switch (id) {
+		case SY_GROUP_BRIGHTNESS:	sy060_brightness(data->client, val);	break;
+		case SY_GROUP_DISPLAY:		sy060_display(data, val);				break;
+		case SY_GROUP_ROTATE:		sy060_rotate(data->client, val);		break;
+		case SY_GROUP_LOW_PERSISTENCE:	sy060_low_persistence(data, val);	break;
+		case SY_GROUP_RESET:		sy060_reset(data);						break;
+		case SY_GROUP_BLANK:		sy060_blank(data, val);					break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// same value to every panel : each eye is on its own adapter, only one transfer apart
+int sy060_group_set(int id, int val)
+{
+	struct sy060_data *data;
+	ktime_t start;
+	int cnt = 0;
+
+	mutex_lock(&sy060_group_lock);
+	start = ktime_get();
+	list_for_each_entry(data, &sy060_group, group) {
+		sy060_set(data, id, val);
+		cnt++;
+	}
+	sy060_group_skew_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	mutex_unlock(&sy060_group_lock);
+
+	return cnt;
+}
+EXPORT_SYMBOL_GPL(sy060_group_set);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////	
 static ssize_t sy060_disp_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	if (buf == NULL)
 		return 0;
-	printk("[Panel] Get Display %s\n", s06_cfg.display ? "On" : "Off");
-	return sprintf(buf, "%d\n", s06_cfg.display);
+	return sprintf(buf, "%d\n", ((struct sy060_data *)dev_get_drvdata(dev))->display);
 }
 
 static ssize_t sy060_disp_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
-	struct i2c_client *client = to_i2c_client(dev);
 	int val = _atoi(buf);
 	if (buf == NULL)
 		return count;
-	printk("[Panel] Set Display %s\n", val ? "On" : "Off");
-	sy060_write(client, (val ? SY_DISP_ON_REG : SY_DISP_OFF_REG), 0x00);
-	s06_cfg.display = val;
+	dev_dbg(dev, "Set Display %s\n", val ? "On" : "Off");
+	sy060_display(dev_get_drvdata(dev), val);
 	return count;
 }
 static DEVICE_ATTR(display, 0660, sy060_disp_show, sy060_disp_store);
@@ -211,10 +831,10 @@ static DEVICE_ATTR(display, 0660, sy060_disp_show, sy060_disp_store);
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////	
 static ssize_t sy060_brightness_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
+	struct i2c_client *client = to_i2c_client(dev);
 	if (buf == NULL)
 		return 0;
-	printk("[Panel] Get Brightness %d\n", s06_cfg.brightness);
-	return sprintf(buf, "%d\n", s06_cfg.brightness);
+	return sprintf(buf, "%d\n", sy060_get_brightness(client));
 }
 
 static ssize_t sy060_brightness_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
@@ -223,20 +843,29 @@ static ssize_t sy060_brightness_store(struct device *dev, struct device_attribut
 	int val = _atoi(buf);
 	if (buf == NULL)
 		return count;
-	printk("[Panel] Set Brightness %d\n", val);
+	dev_dbg(dev, "Set Brightness %d\n", val);
 	sy060_brightness(client, val);
-	s06_cfg.brightness = val;
 	return count;
 }
 static DEVICE_ATTR(brightness, 0660, sy060_brightness_show, sy060_brightness_store);
 
+static ssize_t sy060_nits_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	int val = sy060_get_brightness(client);
+	if (buf == NULL)
+		return 0;
+	return sprintf(buf, "%d\n", (val <= MAX_BRIGHTNESS) ? sy060_nits[val] : 0);
+}
+static DEVICE_ATTR(nits, 0444, sy060_nits_show, NULL);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////	
 static ssize_t sy060_rotate_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
+	struct i2c_client *client = to_i2c_client(dev);
 	if (buf == NULL)
 		return 0;
-	printk("[Panel] Get Brightness %d\n", s06_cfg.brightness);
-	return sprintf(buf, "%d\n", s06_cfg.brightness);
+	return sprintf(buf, "%d\n", sy060_get_rotate(client));
 }
 
 static ssize_t sy060_rotate_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
@@ -245,19 +874,93 @@ static ssize_t sy060_rotate_store(struct device *dev, struct device_attribute *a
 	int val = _atoi(buf);
 	if (buf == NULL)
 		return count;
-	printk("[Panel] Set Rotate %d\n", val);
+	dev_dbg(dev, "Set Rotate %d\n", val);
 	sy060_rotate(client, val);
-	s06_cfg.brightness = val;
 	return count;
 }
 static DEVICE_ATTR(rotate, 0660, sy060_rotate_show, sy060_rotate_store);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////	
+static ssize_t sy060_lp_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	if (buf == NULL)
+		return 0;
+	return sprintf(buf, "%d\n", ((struct sy060_data *)dev_get_drvdata(dev))->lp_user);
+}
+
+static ssize_t sy060_lp_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	int val = _atoi(buf);
+	if (buf == NULL)
+		return count;
+	dev_dbg(dev, "Set Low Persistence %d\n", val);
+	sy060_low_persistence(dev_get_drvdata(dev), val);
+	return count;
+}
+static DEVICE_ATTR(low_persistence, 0660, sy060_lp_show, sy060_lp_store);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// group_xxx : read this panel, write every panel
+#define SY_GROUP_RW(_name, _id, _show) \
+static ssize_t sy060_group_##_name##_store(struct device *dev, \
+			struct device_attribute *attr, const char *buf, size_t count) \
+{ \
+	if (buf == NULL) return count; \
+	sy060_group_set(_id, _atoi(buf)); \
+	return count; \
+} \
+static DEVICE_ATTR(group_##_name, 0660, _show, sy060_group_##_name##_store);
+
+SY_GROUP_RW(brightness, SY_GROUP_BRIGHTNESS, sy060_brightness_show);
+SY_GROUP_RW(display, SY_GROUP_DISPLAY, sy060_disp_show);
+SY_GROUP_RW(rotate, SY_GROUP_ROTATE, sy060_rotate_show);
+SY_GROUP_RW(low_persistence, SY_GROUP_LOW_PERSISTENCE, sy060_lp_show);
+
+static ssize_t sy060_group_skew_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	if (buf == NULL)
+		return 0;
+	return sprintf(buf, "%lld\n", sy060_group_skew_ns / 1000);	// us
+}
+static DEVICE_ATTR(group_skew, 0444, sy060_group_skew_show, NULL);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static ssize_t sy060_rail_off_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	if (buf == NULL)
+		return 0;
+	return sprintf(buf, "%d\n", ((struct sy060_data *)dev_get_drvdata(dev))->rail_off);
+}
+
+static ssize_t sy060_rail_off_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct sy060_data *data = dev_get_drvdata(dev);
+	if (buf == NULL)
+		return count;
+	mutex_lock(&data->update_lock);
+	data->rail_off = _atoi(buf) ? 1 : 0;
+	// arg24io may have probed after this panel
+	if (data->rail_off && !data->rail && !data->cold)
+		data->rail = sy060_rail_get();
+	mutex_unlock(&data->update_lock);
+	return count;
+}
+static DEVICE_ATTR(rail_off, 0660, sy060_rail_off_show, sy060_rail_off_store);
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 static struct attribute *sy060_attributes[] = {
 	&dev_attr_display.attr,
 	&dev_attr_brightness.attr,	
+	&dev_attr_nits.attr,
 	&dev_attr_rotate.attr,	
+	&dev_attr_group_brightness.attr,
+	&dev_attr_group_display.attr,
+	&dev_attr_group_rotate.attr,
+	&dev_attr_low_persistence.attr,
+	&dev_attr_group_low_persistence.attr,
+	&dev_attr_group_skew.attr,
+	&dev_attr_rail_off.attr,
 	NULL
 };
 
@@ -265,6 +968,122 @@ static const struct attribute_group sy060_attr_group = {
 	.attrs = sy060_attributes,
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// pm_stat/xxx_ms : time spent in each PM_STATE since probe
+#define SY_PM_TIME(_name, _state) \
+static ssize_t sy060_pm_##_name##_show(struct device *dev, \
+			struct device_attribute *attr, char *buf) \
+{ \
+	struct sy060_data *data = dev_get_drvdata(dev); \
+	ktime_t t; \
+	if (buf == NULL) return 0; \
+	mutex_lock(&data->update_lock); \
+	t = data->pm_time[_state]; \
+	if (data->pm_state == _state) \
+		t = ktime_add(t, ktime_sub(ktime_get_boottime(), data->pm_since)); \
+	mutex_unlock(&data->update_lock); \
+	return sprintf(buf, "%lld\n", ktime_to_ms(t)); \
+} \
+static DEVICE_ATTR(_name##_ms, 0444, sy060_pm_##_name##_show, NULL);
+
+SY_PM_TIME(active, pm_active);
+SY_PM_TIME(blank, pm_blank);
+SY_PM_TIME(sleep, pm_sleep);
+SY_PM_TIME(off, pm_off);
+
+// pm_stat/resume_xxx : runtime resume -> display and registers restored
+#define SY_PM_RESUME(_name, _field) \
+static ssize_t sy060_resume_##_name##_show(struct device *dev, \
+			struct device_attribute *attr, char *buf) \
+{ \
+	struct sy060_data *data = dev_get_drvdata(dev); \
+	long long val; \
+	if (buf == NULL) return 0; \
+	mutex_lock(&data->update_lock); \
+	val = data->_field; \
+	mutex_unlock(&data->update_lock); \
+	return sprintf(buf, "%lld\n", val); \
+} \
+static DEVICE_ATTR(resume_##_name, 0444, sy060_resume_##_name##_show, NULL);
+
+SY_PM_RESUME(count, resume_cnt);
+SY_PM_RESUME(last_us, resume_last_us);
+SY_PM_RESUME(max_us, resume_max_us);
+SY_PM_RESUME(fast, resume_fast);
+SY_PM_RESUME(full, resume_full);
+
+static struct attribute *sy060_pm_attributes[] = {
+	&dev_attr_active_ms.attr,
+	&dev_attr_blank_ms.attr,
+	&dev_attr_sleep_ms.attr,
+	&dev_attr_off_ms.attr,
+	&dev_attr_resume_count.attr,
+	&dev_attr_resume_last_us.attr,
+	&dev_attr_resume_max_us.attr,
+	&dev_attr_resume_fast.attr,
+	&dev_attr_resume_full.attr,
+	NULL
+};
+
+static const struct attribute_group sy060_pm_attr_group = {
+	.name = "pm_stat",
+	.attrs = sy060_pm_attributes,
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// debugfs sy060/<i2c client>/xfer_hist : bus transfer latency and retries, any write clears it
+static int sy060_hist_show(struct seq_file *m, void *v)
+{
+	struct sy060_data *data = m->private;
+	u32 lat[SY_HIST_BUCKETS], retry[SY_XFER_RETRY + 1], errors;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&data->hist_lock, flags);
+	memcpy(lat, data->lat_hist, sizeof(lat));
+	memcpy(retry, data->retry_hist, sizeof(retry));
+	errors = data->xfer_errors;
+	spin_unlock_irqrestore(&data->hist_lock, flags);
+
+	seq_puts(m, "latency\n");
+	for (i = 0; i < SY_HIST_BUCKETS; i++)
+		if (lat[i])
+			seq_printf(m, "  %s %6llu us : %u\n", (i < SY_HIST_BUCKETS - 1) ? "<" : ">=",
+				1ULL << ((i < SY_HIST_BUCKETS - 1) ? i : i - 1), lat[i]);
+	seq_puts(m, "retries\n");
+	for (i = 0; i <= SY_XFER_RETRY; i++)
+		seq_printf(m, "  %d : %u\n", i, retry[i]);
+	seq_printf(m, "errors : %u\n", errors);
+	return 0;
+}
+
+static int sy060_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sy060_hist_show, inode->i_private);
+}
+
+static ssize_t sy060_hist_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct sy060_data *data = ((struct seq_file *)file->private_data)->private;
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->hist_lock, flags);
+	memset(data->lat_hist, 0, sizeof(data->lat_hist));
+	memset(data->retry_hist, 0, sizeof(data->retry_hist));
+	data->xfer_errors = 0;
+	spin_unlock_irqrestore(&data->hist_lock, flags);
+	return count;
+}
+
+static const struct file_operations sy060_hist_fops = {
+	.owner = THIS_MODULE,
+	.open = sy060_hist_open,
+	.read = seq_read,
+	.write = sy060_hist_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static struct of_device_id sy060_dt_ids[] = {
 	{ .compatible = "seeya,sy060" },
 	{},
@@ -272,77 +1091,120 @@ static struct of_device_id sy060_dt_ids[] = {
 MODULE_DEVICE_TABLE(of, sy060_dt_ids);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static int sy060_init_client(struct i2c_client *client)
+// drm_panel : blanking follows the atomic commit of the VOP / bridge chain the panel sits on.
+// prepare / unprepare : sleep-out / sleep-in (runtime PM), enable / disable : display on / off
+static inline struct sy060_data *panel_to_sy060(struct drm_panel *panel)
+{
+	return container_of(panel, struct sy060_data, panel);
+}
+
+// mode of the commit in progress, the connector state is already the new one
+static int sy060_panel_mode(struct sy060_data *data)
 {
-	int ret = sy060_write(client, 0xFF00, 0x5A);
+	struct drm_connector *connector = data->connector;
+	struct drm_crtc_state *crtc_state;
+	int i;
+
+	if (!connector || !connector->state || !connector->state->crtc)
+		return data->mode_next;
+
+	crtc_state = connector->state->crtc->state;
+	for (i = 0; i < data->nmodes; i++)
+		if (drm_mode_match(&crtc_state->mode, &data->modes[i].mode,
+				DRM_MODE_MATCH_TIMINGS | DRM_MODE_MATCH_CLOCK | DRM_MODE_MATCH_FLAGS))
+			return i;
+	return data->native;
+}
+
+// mode registers go with the resume, before the sleep-out. already awake : only what differs
+static int sy060_panel_prepare(struct drm_panel *panel)
+{
+	struct sy060_data *data = panel_to_sy060(panel);
+	struct device *dev = &data->client->dev;
+	int ret = 0;
+
+	mutex_lock(&data->display_lock);
+	if (data->prepared)
+		goto out;
+
+	data->drm = 1;
+	mutex_lock(&data->update_lock);
+	data->mode_next = sy060_panel_mode(data);
+	sy060_lp_update(data);
+	mutex_unlock(&data->update_lock);
+
+	ret = pm_runtime_get_sync(dev);
 	if (ret < 0) {
-		goto exit;
+		pm_runtime_put_noidle(dev);
+		goto out;
 	}
-	printk("[sy102] check i2c = %02X\n", sy060_read(client, 0xFF00));
-
- 	sy060_write(client, 0xFF01, 0x81);
- 	sy060_write(client, 0xF406, 0x55);
- 	sy060_write(client, 0x5300, 0x24);
- 	sy060_write(client, 0x5100, 0xFF);
- 	sy060_write(client, 0x5101, 0x00);
- 	sy060_write(client, 0x0300, 0x00);
- 	sy060_write(client, 0x8000, 0x01);
- 	sy060_write(client, 0x8001, 0xE0);
- 	sy060_write(client, 0x8002, 0xE0);
- 	sy060_write(client, 0x8003, 0x0E);
- 	sy060_write(client, 0x8004, 0x00);
- 	sy060_write(client, 0x8005, 0x31);
- 	sy060_write(client, 0x8100, 0x04);
- 	sy060_write(client, 0x8101, 0x82);
- 	sy060_write(client, 0x8102, 0x00);
- 	sy060_write(client, 0x8103, 0x10);
- 	sy060_write(client, 0x8104, 0x00);
- 	sy060_write(client, 0x8105, 0x10);
- 	sy060_write(client, 0x8106, 0x00);
- 	sy060_write(client, 0x8107, 0x04);
- 	sy060_write(client, 0x8108, 0x82);
- 	sy060_write(client, 0x8109, 0x00);
- 	sy060_write(client, 0x810A, 0x10);
- 	sy060_write(client, 0x810B, 0x00);
- 	sy060_write(client, 0x810C, 0x10);
- 	sy060_write(client, 0x810D, 0x00);
- 	sy060_write(client, 0x810E, 0x04);
- 	sy060_write(client, 0x810F, 0x82);
- 	sy060_write(client, 0x8110, 0x00);
- 	sy060_write(client, 0x8111, 0x10);
- 	sy060_write(client, 0x8112, 0x00);
- 	sy060_write(client, 0x8113, 0x10);
- 	sy060_write(client, 0x8114, 0x00);
- 	sy060_write(client, 0x6C00, 0x00);
- 	sy060_write(client, 0x3500, 0x00);
- 	sy060_write(client, 0x2600, 0x20);
- 	sy060_write(client, 0xFF00, 0x5A);
- 	sy060_write(client, 0xFF01, 0x80);
- 	sy060_write(client, 0xF249, 0x01);
- 	sy060_write(client, 0xFF00, 0x5A);
- 	sy060_write(client, 0xFF01, 0x81);
- 	sy060_write(client, 0xF61D, 0x30);
- 	sy060_write(client, 0xF429, 0x04);
- 	
- 	sy060_write(client, 0xF000, 0xAA);
- 	sy060_write(client, 0xF001, 0x10);
- 	sy060_write(client, 0xB102, 0x09);
- 	
-	sy060_write(client, 0x1100, 0x00);
-	mdelay(100);
-	sy060_write(client, 0x2900, 0x00);
-	
-	return 1;
+	data->prepared = 1;
+	ret = 0;
 
-exit:
-	printk("%s: error ret = %d\n", __func__, ret);
+	mutex_lock(&data->update_lock);
+	sy060_mode_apply(data);
+	mutex_unlock(&data->update_lock);
+out:
+	mutex_unlock(&data->display_lock);
 	return ret;
 }
 
+// video is running : the display-on follows the sleep-out settle, no garbage frame
+static int sy060_panel_enable(struct drm_panel *panel)
+{
+	sy060_display(panel_to_sy060(panel), 1);
+	return 0;
+}
+
+static int sy060_panel_disable(struct drm_panel *panel)
+{
+	sy060_display(panel_to_sy060(panel), 0);
+	return 0;
+}
+
+// sleep-in right away, not after AUTOSUSPEND_MS
+static int sy060_panel_unprepare(struct drm_panel *panel)
+{
+	struct sy060_data *data = panel_to_sy060(panel);
+
+	mutex_lock(&data->display_lock);
+	if (data->prepared) {
+		data->prepared = 0;
+		pm_runtime_put_sync_suspend(&data->client->dev);
+	}
+	mutex_unlock(&data->display_lock);
+	return 0;
+}
+
+static int sy060_panel_get_modes(struct drm_panel *panel, struct drm_connector *connector)
+{
+	struct sy060_data *data = panel_to_sy060(panel);
+	struct drm_display_mode *mode;
+	int i;
+
+	data->connector = connector;
+	for (i = 0; i < data->nmodes; i++) {
+		mode = drm_mode_duplicate(connector->dev, &data->modes[i].mode);
+		if (!mode)
+			return i;
+		drm_mode_probed_add(connector, mode);
+	}
+	return data->nmodes;
+}
+
+static const struct drm_panel_funcs sy060_panel_funcs = {
+	.get_modes = sy060_panel_get_modes,
+	.prepare = sy060_panel_prepare,
+	.enable = sy060_panel_enable,
+	.disable = sy060_panel_disable,
+	.unprepare = sy060_panel_unprepare,
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 static int sy060_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
 	struct i2c_adapter *adapter = to_i2c_adapter(client->dev.parent);
+	struct sy060_data *data;
 	int err = 0;
 
 	if (!i2c_check_functionality(adapter, I2C_FUNC_I2C)) {
@@ -350,46 +1212,216 @@ static int sy060_probe(struct i2c_client *client, const struct i2c_device_id *id
 		goto exit;
 	}
 
-	g_data = kzalloc(sizeof(struct sy060_data), GFP_KERNEL);
-	if (!g_data) {
+	data = kzalloc(sizeof(struct sy060_data), GFP_KERNEL);
+	if (!data) {
 		err = -ENOMEM;
 		goto exit;
 	}
-	g_data->client = client;
-	i2c_set_clientdata(client, g_data);
+	data->client = client;
+	i2c_set_clientdata(client, data);
 
-	mutex_init(&g_data->update_lock);
+	data->regmap = devm_regmap_init_i2c(client, &sy060_regmap_config);
+	if (IS_ERR(data->regmap)) {
+		err = PTR_ERR(data->regmap);
+		goto exit_kfree;
+	}
 
-	memset(&s06_cfg, 0, sizeof(s06_cfg));
-	
-	s06_cfg.display = 1;
-	s06_cfg.brightness = 4;
+	mutex_init(&data->update_lock);
+	mutex_init(&data->display_lock);
+	spin_lock_init(&data->hist_lock);
+	INIT_DELAYED_WORK(&data->SY060_work, sy060_display_work);
+	sy060_parse_modes(data);
 
+	data->display = 1;
+	data->pm_state = pm_active;
+	data->pm_since = ktime_get_boottime();
+
+	// the init table is the panel's reset state, not something regcache_sync may replay
+	regcache_cache_bypass(data->regmap, true);
 	sy060_init_client(client);
+	regcache_cache_bypass(data->regmap, false);
+
+	// default level, sent with the display-on by regcache_sync
+	regcache_cache_only(data->regmap, true);
+	regmap_write(data->regmap, SY_BRIGHTNESS_REG, BRIGHTNESS_DEFAULT);
+	regcache_cache_only(data->regmap, false);
 
 	/* Register sysfs hooks */
 	err = sysfs_create_group(&client->dev.kobj, &sy060_attr_group);
 	if (err)
-		goto exit_kfree;
+		goto exit_cancel;
+	err = sysfs_create_group(&client->dev.kobj, &sy060_pm_attr_group);
+	if (err)
+		goto exit_sysfs;
+
+	data->rail = sy060_rail_get();
+
+	// display on : active, with the reference sy060_display drops on display off
+	pm_runtime_set_active(&client->dev);
+	pm_runtime_get_noresume(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev, AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	pm_runtime_enable(&client->dev);
+
+	mutex_lock(&sy060_group_lock);
+	list_add_tail(&data->group, &sy060_group);
+	mutex_unlock(&sy060_group_lock);
+
+	// looked up through the OF graph (sy060_in) by the display output the board dtsi links to it,
+	// the SoC side is DisplayPort : a built-in DisplayPort display. without display-timings there is
+	// no mode to give the connector, the panel stays with sysfs / armon control
+	if (data->nmodes) {
+		drm_panel_init(&data->panel, &client->dev, &sy060_panel_funcs, DRM_MODE_CONNECTOR_eDP);
+		drm_panel_add(&data->panel);
+	} else {
+		dev_info(&client->dev, "no display-timings, not a drm_panel\n");
+	}
+
+	data->debugfs = debugfs_create_dir(dev_name(&client->dev), sy060_debugfs);
+	debugfs_create_file("xfer_hist", 0600, data->debugfs, data, &sy060_hist_fops);
 
 	dev_info(&client->dev, "support ver. %s enabled\n", DRIVER_VERSION);
 
 	return 0;
 
+exit_sysfs:
+	sysfs_remove_group(&client->dev.kobj, &sy060_attr_group);
+exit_cancel:
+	cancel_delayed_work_sync(&data->SY060_work);
 exit_kfree:
-	kfree(g_data);
+	kfree(data);
 exit:
 	return err;
 }
 
 static int sy060_remove(struct i2c_client *client)
 {
+	struct sy060_data *data = i2c_get_clientdata(client);
+
+	if (data->nmodes)
+		drm_panel_remove(&data->panel);
+	debugfs_remove_recursive(data->debugfs);
+
+	mutex_lock(&sy060_group_lock);
+	list_del(&data->group);
+	mutex_unlock(&sy060_group_lock);
+
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	mutex_lock(&data->display_lock);
+	if (data->display)
+		pm_runtime_put_noidle(&client->dev);
+	if (data->prepared)
+		pm_runtime_put_noidle(&client->dev);
+	mutex_unlock(&data->display_lock);
+	pm_runtime_set_suspended(&client->dev);
+
+	cancel_delayed_work_sync(&data->SY060_work);
+	sysfs_remove_group(&client->dev.kobj, &sy060_pm_attr_group);
 	sysfs_remove_group(&client->dev.kobj, &sy060_attr_group);
-	kfree(i2c_get_clientdata(client));
+	if (data->rail)
+		sy060_rail_put();
+	kfree(data);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// display off for AUTOSUSPEND_MS : sleep-in keeps the registers, writes meanwhile only land in the cache
+static int __maybe_unused sy060_runtime_suspend(struct device *dev)
+{
+	struct sy060_data *data = dev_get_drvdata(dev);
+
+	cancel_delayed_work_sync(&data->SY060_work);
+
+	mutex_lock(&data->update_lock);
+	sy060_write(data->client, SY_SLEEP_IN_REG, 0x00);
+	data->flip_hw = sy060_read(data->client, SY_FLIP_REG);	// cache = panel until cache only
+	regcache_cache_only(data->regmap, true);
+
+	// panel_reset is shared, the rails only drop once every panel let go of them
+	if (data->rail_off && data->rail) {
+		msleep(SLEEP_IN_MS);
+		sy060_rail_put();
+		data->rail = 0;
+		data->cold = 1;
+		regcache_mark_dirty(data->regmap);
+	}
+	sy060_pm_state(data, data->cold ? pm_off : pm_sleep);
+	mutex_unlock(&data->update_lock);
+	return 0;
+}
 
+// sleep-out only, sy060_display_work sends the display-on and the registers written while asleep
+static int __maybe_unused sy060_runtime_resume(struct device *dev)
+{
+	struct sy060_data *data = dev_get_drvdata(dev);
+
+	mutex_lock(&data->update_lock);
+	data->resume_start = ktime_get();
+	regcache_cache_only(data->regmap, false);
+
+	if (data->cold) {
+		if (!data->rail)
+			data->rail = sy060_rail_get();
+		sy060_restore(data);
+		data->cold = 0;
+	} else {
+		data->xfer_cnt = 1;
+		data->xfer_bytes = 3;
+		sy060_mode_apply(data);
+		sy060_write(data->client, SY_SLEEP_OUT_REG, 0x00);
+		schedule_delayed_work(&data->SY060_work, msecs_to_jiffies(SLEEP_OUT_MS));
+	}
+	mutex_unlock(&data->update_lock);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// panel power may be cut in suspend : writes meanwhile only land in the cache
+static int __maybe_unused sy060_suspend(struct device *dev)
+{
+	struct sy060_data *data = dev_get_drvdata(dev);
+
+	cancel_delayed_work_sync(&data->SY060_work);
+
+	mutex_lock(&data->update_lock);
+	// a runtime suspended panel kept the flip of its runtime suspend
+	if (!pm_runtime_status_suspended(dev))
+		data->flip_hw = sy060_read(data->client, SY_FLIP_REG);
+	regcache_cache_only(data->regmap, true);
+	regcache_mark_dirty(data->regmap);
+	data->resume_start = 0;
+	data->cold = 1;
+	sy060_pm_state(data, pm_off);
+	mutex_unlock(&data->update_lock);
 	return 0;
 }
 
+// sleep-out or the init table, sy060_display_work puts display and the cached brightness / flip back.
+// a runtime suspended panel stays down until its runtime resume
+static int __maybe_unused sy060_resume(struct device *dev)
+{
+	struct sy060_data *data = dev_get_drvdata(dev);
+
+	if (pm_runtime_status_suspended(dev))
+		return 0;
+
+	mutex_lock(&data->update_lock);
+	regcache_cache_only(data->regmap, false);
+
+	sy060_restore(data);
+	data->cold = 0;
+	mutex_unlock(&data->update_lock);
+
+	return 0;
+}
+
+static const struct dev_pm_ops sy060_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(sy060_suspend, sy060_resume)
+	SET_RUNTIME_PM_OPS(sy060_runtime_suspend, sy060_runtime_resume, NULL)
+};
+
 static const struct i2c_device_id sy060_id[] = {
 	{"sy060", 0},
 	{}
@@ -402,6 +1434,8 @@ static struct i2c_driver sy060_driver = {
 		.name = SY060_DEV_NAME,
 		.owner = THIS_MODULE,
 		.of_match_table = of_match_ptr(sy060_dt_ids),		   
+		.pm = &sy060_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = sy060_probe,
 	.remove = sy060_remove,
@@ -410,12 +1444,14 @@ static struct i2c_driver sy060_driver = {
 
 static int __init sy060_init(void)
 {
+	sy060_debugfs = debugfs_create_dir(SY060_DEV_NAME, NULL);
 	return i2c_add_driver(&sy060_driver);
 }
 
 static void __exit sy060_exit(void)
 {
 	i2c_del_driver(&sy060_driver);
+	debugfs_remove_recursive(sy060_debugfs);
 }
 
 MODULE_DESCRIPTION("SeeYA OLED 0.6inch Panel");
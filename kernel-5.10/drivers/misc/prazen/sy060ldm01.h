@@ -11,9 +11,27 @@
 #ifndef _DRV_SY060_H_
 #define _DRV_SY060_H_
 
+#define SY_SLEEP_IN_REG			0x1000
+#define SY_SLEEP_OUT_REG		0x1100
 #define SY_DISP_OFF_REG			0x2800
 #define SY_DISP_ON_REG			0x2900
 #define SY_FLIP_REG				0x3600
 #define SY_BRIGHTNESS_REG		0x5100
+#define SY_BRIGHTNESS2_REG		0x5101
+
+#define SY_MAX_BRIGHTNESS		0x7A		// SY_BRIGHTNESS_REG limit
+
+// group control : one value to every sy060 (one panel per eye)
+enum {
+	SY_GROUP_BRIGHTNESS,	// 0 .. SY_MAX_BRIGHTNESS, armon is the only writer (group_brightness)
+	SY_GROUP_DISPLAY,
+	SY_GROUP_ROTATE,
+	SY_GROUP_BLANK,			// FB blank : display, unless the DRM pipeline drives the panel
+	SY_GROUP_LOW_PERSISTENCE,
+	SY_GROUP_RESET,			// panel_reset / lt_reset released : registers lost, reload the panel
+};
+
+extern int sy060_group_set(int id, int val);	// returns the number of panels
+extern const u16 sy060_nits[SY_MAX_BRIGHTNESS + 1];	// luminance per brightness level
 
 #endif	//_DRV_SY060_H_
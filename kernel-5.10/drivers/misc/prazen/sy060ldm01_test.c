@@ -0,0 +1,67 @@
+/*
+ *  sy060ldm01_test.c - SeeYA OLED 0.6' panel driver, KUnit tests
+ *
+ *  Copyright (C) 2024 Prazen Co., Ltd.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ */
+
+#include <kunit/test.h>
+
+#include "sy060ldm01.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// the branch chain sy060_nits[] was expanded from, kept as the reference
+static int get_nits(u8 val)
+{
+	int nits = 0;
+	if (1 == val) {
+		nits = 300;	// 0x01
+	} else if (2 <= val && val <= 9) {
+		nits = ((200 * 10) / 9 * (val - 1) / 10) + 300;
+	} else if (10 == val) {
+		nits = 500;
+	} else if (11 <= val && val <= 19) {
+		nits = (200 / 10 * (val - 10)) + 500;
+	} else if (20 == val) {
+		nits = 700;
+	} else if (21 <= val && val <= 29) {
+		nits = (200 / 10 * (val - 20)) + 500;
+	} else if (30 == val) {
+		nits = 900;
+	} else if (31 <= val && val <= 103) {
+		nits = ((1700 * 100) / 74 * (val - 30) / 100) + 900;
+	} else if (104 == val) {
+		nits = 2600;
+	} else if (105 <= val && val <= 179) {
+		nits = ((1700 * 100) / 76 * (val - 104) / 100) + 2600;
+	}
+	return nits;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// every brightness level 0 .. SY_MAX_BRIGHTNESS
+static void sy060_nits_table_test(struct kunit *test)
+{
+	int val;
+
+	KUNIT_EXPECT_EQ(test, (int)ARRAY_SIZE(sy060_nits), SY_MAX_BRIGHTNESS + 1);
+	for (val = 0; val <= SY_MAX_BRIGHTNESS; val++)
+		KUNIT_EXPECT_EQ_MSG(test, (int)sy060_nits[val], get_nits(val), "level %d", val);
+}
+
+static struct kunit_case sy060_test_cases[] = {
+	KUNIT_CASE(sy060_nits_table_test),
+	{}
+};
+
+static struct kunit_suite sy060_test_suite = {
+	.name = "sy060",
+	.test_cases = sy060_test_cases,
+};
+kunit_test_suites(&sy060_test_suite);
+
+MODULE_LICENSE("GPL");
@@ -24,4 +24,8 @@ extern int file_read(struct file *fp, char *buf, int readlen);
 extern int file_write(struct file *fp, char *buf, int writelen);
 extern int file_close(struct file *fp);
 
+// arg24io : panel rails (panel_reset), refcounted over every sy060
+extern int ar_panel_get(void);
+extern void ar_panel_put(void);
+
 #endif  /*__TYPES_H__*/
@@ -44,36 +44,6 @@ struct pwm_bl_data {
 	void			(*exit)(struct device *);
 };
 
-#define PATH_DISP		"/sys/bus/i2c/devices/3-004c/brightness"
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-void ar_set_brightness(char *path, int val)
-{
-	char buf[4];
-	mm_segment_t fs;
-	struct file *fp;
-
-	fs = get_fs();
-	set_fs(KERNEL_DS);
-	
-	fp = filp_open(path, O_RDWR, 0664);
-	if (IS_ERR(fp)) {
-		printk("%s: file open error\n", __FUNCTION__);
-        return;
-	}
-	
-	if (fp) {
-		loff_t f_pos = 0;
-		int len = sizeof(buf);
-		sprintf(buf, "%d\n", val);
-		if (vfs_write(fp, buf, len, &f_pos) != len) {
-			printk("%s: wrtie error\n", __FUNCTION__);
-		}
-		filp_close(fp, NULL);
-		set_fs(fs);	
-	}
-}
-
 static void pwm_backlight_power_on(struct pwm_bl_data *pb)
 {
 	struct pwm_state state;
@@ -155,7 +125,9 @@ static int pwm_backlight_update_status(struct backlight_device *bl)
 		pwm_apply_state(pb->pwm, &state);
 		pwm_backlight_power_on(pb);
 		// [feature development] mspark, 24.09.24, Add Brightness driver control
-		ar_set_brightness(PATH_DISP, brightness);
+		// ar_set_brightness(PATH_DISP, brightness);
+		// [feature modify] mspark, 26.10.17, removed : the backlight slider only sets this PWM duty,
+		// it does not change the sy060 panel brightness. armon (keys, auto brightness) is its only writer
 	} else {
 		pwm_backlight_power_off(pb);
 	}